@@ -0,0 +1,516 @@
+#include "ByteCodeOptimiser.h"
+
+int ByteCodeOptimiser::optimise(std::vector<Op>& byteCode, std::vector<double>& numberConstants)
+{
+	if (byteCode.empty()) return 0;
+
+	ByteCodeOptimiser optimiser(byteCode, numberConstants);
+
+	const auto root = optimiser.simplify(optimiser.root);
+
+	std::vector<Op> optimisedCode;
+	std::vector<double> optimisedConstants;
+	optimiser.write(root, optimisedCode, optimisedConstants);
+
+	// Rewritten powers can make the code longer, but it is still faster
+	const auto numRemoved = juce::jmax(0, (int)byteCode.size() - (int)optimisedCode.size());
+
+	std::swap(byteCode, optimisedCode);
+	std::swap(numberConstants, optimisedConstants);
+
+	return numRemoved;
+}
+
+std::vector<ByteCodeOptimiser::HoistedValue> ByteCodeOptimiser::hoist(std::vector<Op>& byteCode, std::vector<double>& numberConstants,
+	const std::array<Rate, expr_node_num_ins>& inputRates, const std::vector<Rate>& valueRates)
+{
+	std::vector<HoistedValue> values;
+
+	if (byteCode.empty()) return values;
+
+	ByteCodeOptimiser optimiser(byteCode, numberConstants);
+
+	optimiser.hoistSubexpressions(optimiser.root, optimiser.getRates(inputRates, valueRates), values);
+
+	if (values.empty()) return values;
+
+	byteCode.clear();
+	numberConstants.clear();
+	optimiser.write(optimiser.root, byteCode, numberConstants);
+
+	return values;
+}
+
+void ByteCodeOptimiser::normalise(std::vector<Op>& byteCode, std::vector<double>& numberConstants)
+{
+	if (byteCode.empty()) return;
+
+	ByteCodeOptimiser optimiser(byteCode, numberConstants);
+
+	byteCode.clear();
+	numberConstants.clear();
+	optimiser.writeNormalised(optimiser.root, byteCode, numberConstants);
+}
+
+ByteCodeOptimiser::Rate ByteCodeOptimiser::getRate(const std::vector<Op>& byteCode, const std::vector<double>& numberConstants,
+	const std::array<Rate, expr_node_num_ins>& inputRates, const std::vector<Rate>& valueRates)
+{
+	if (byteCode.empty()) return Rate::constant;
+
+	ByteCodeOptimiser optimiser(byteCode, numberConstants);
+
+	return optimiser.getRates(inputRates, valueRates)[(size_t)optimiser.root];
+}
+
+ByteCodeOptimiser::ByteCodeOptimiser(const std::vector<Op>& byteCode, const std::vector<double>& numberConstants)
+{
+	std::vector<int> stack;
+	int nextNum = 0;
+
+	for (const auto op : byteCode)
+	{
+		const auto arity = ByteCodeProcessor::tokens[op].arity;
+
+		const auto hasConstant = op == Op::numberConstant || op == Op::cachedValue || op == Op::nodeValue;
+		Node node{ op, hasConstant ? numberConstants[nextNum++] : 0.0, { -1, -1 } };
+
+		for (int i = arity; --i >= 0;)
+		{
+			node.operands[i] = stack.back();
+			stack.pop_back();
+		}
+
+		nodes.push_back(node);
+		stack.push_back((int)nodes.size() - 1);
+	}
+
+	jassert(stack.size() == 1);
+	root = stack.back();
+}
+
+int ByteCodeOptimiser::simplify(int index)
+{
+	const auto op = nodes[index].op;
+	const auto arity = ByteCodeProcessor::tokens[op].arity;
+
+	bool constantOperands = arity > 0;
+
+	for (int i = 0; i < arity; ++i)
+	{
+		const auto operand = simplify(nodes[index].operands[i]);
+		nodes[index].operands[i] = operand;
+		constantOperands = constantOperands && nodes[operand].op == Op::numberConstant;
+	}
+
+	const auto x = nodes[index].operands[0];
+	const auto y = nodes[index].operands[1];
+
+	auto& node = nodes[index];
+
+	switch (op)
+	{
+	case Op::pi: node = { Op::numberConstant, juce::MathConstants<double>::pi, { -1, -1 } };
+		return index;
+	case Op::twopi: node = { Op::numberConstant, juce::MathConstants<double>::twoPi, { -1, -1 } };
+		return index;
+	case Op::halfpi: node = { Op::numberConstant, juce::MathConstants<double>::halfPi, { -1, -1 } };
+		return index;
+	case Op::e: node = { Op::numberConstant, juce::MathConstants<double>::euler, { -1, -1 } };
+		return index;
+	default:;
+	}
+
+	// Whether the comparisons that test for equality are exact depends on the math options, which can change
+	// without the expression being optimised again. They are evaluated when the program runs.
+	const auto comparesEquality = op == Op::equal || op == Op::notequal || op == Op::lessorequal || op == Op::greaterorequal;
+
+	if (constantOperands && !comparesEquality)
+	{
+		const auto value = evaluate(op, nodes[x].value, arity == 2 ? nodes[y].value : 0.0);
+		node = { Op::numberConstant, value, { -1, -1 } };
+		return index;
+	}
+
+	switch (op)
+	{
+	case Op::invert:
+		// _(_x) = x
+		if (nodes[x].op == Op::invert) return nodes[x].operands[0];
+		break;
+
+	case Op::finite:
+		if (isInteger(x) || nodes[x].op == Op::finite) return x;
+		break;
+
+	case Op::add:
+		// Adding +0 turns -0 into +0, which can't happen for integers
+		if (isConstant(y, 0.0) && (std::signbit(nodes[y].value) || isInteger(x))) return x;
+		if (isConstant(x, 0.0) && (std::signbit(nodes[x].value) || isInteger(y))) return y;
+		break;
+
+	case Op::subtract:
+		if (isConstant(y, 0.0) && !std::signbit(nodes[y].value)) return x;
+		break;
+
+	case Op::multiply:
+		if (isConstant(y, 1.0)) return x;
+		if (isConstant(x, 1.0)) return y;
+		break;
+
+	case Op::divide:
+		if (isConstant(y, 1.0)) return x;
+
+		// Dividing by a power of two is the same as multiplying by its reciprocal
+		if (nodes[y].op == Op::numberConstant)
+		{
+			int exponent;
+			const auto reciprocal = 1.0 / nodes[y].value;
+
+			if (std::abs(std::frexp(nodes[y].value, &exponent)) == 0.5 && std::isnormal(reciprocal))
+			{
+				nodes[y].value = reciprocal;
+				node.op = Op::multiply;
+			}
+		}
+		break;
+
+	// The bitwise ops cast their operands to int, so these are only identities if x already is an integer
+	case Op::bitand:
+		if (isConstant(y, -1.0) && isInteger(x)) return x;
+		if (isConstant(x, -1.0) && isInteger(y)) return y;
+		break;
+
+	case Op::bitor:
+	case Op::bitxor:
+		if (isConstant(y, 0.0) && isInteger(x)) return x;
+		if (isConstant(x, 0.0) && isInteger(y)) return y;
+		break;
+
+	case Op::lshift:
+	case Op::rshift:
+		if (isConstant(y, 0.0) && isInteger(x)) return x;
+		break;
+
+	case Op::power:
+		return simplifyPower(index);
+
+	default:;
+	}
+
+	return index;
+}
+
+int ByteCodeOptimiser::simplifyPower(int index)
+{
+	const auto x = nodes[index].operands[0];
+	const auto y = nodes[index].operands[1];
+
+	if (nodes[y].op != Op::numberConstant) return index;
+
+	const auto exponent = nodes[y].value;
+
+	if (exponent == 1.0) return x;
+
+	// Anything to the power of 0 is 1, even nan
+	if (exponent == 0.0 && isPure(x))
+	{
+		nodes[index] = { Op::numberConstant, 1.0, { -1, -1 } };
+		return index;
+	}
+
+	if (exponent == -1.0)
+	{
+		const auto one = addNode(Op::numberConstant, 1.0, -1, -1);
+		nodes[index] = { Op::divide, 0.0, { one, x } };
+		return index;
+	}
+
+	// Small powers are written as multiplications. x is written out once per factor,
+	// so this is only done if x is short and evaluating it more than once doesn't change the result.
+	if (!isPure(x) || getSize(x) > 3) return index;
+
+	if (exponent == 2.0)
+	{
+		nodes[index] = { Op::multiply, 0.0, { x, x } };
+	}
+	else if (exponent == 3.0)
+	{
+		const auto square = addNode(Op::multiply, 0.0, x, x);
+		nodes[index] = { Op::multiply, 0.0, { square, x } };
+	}
+	else if (exponent == 4.0)
+	{
+		const auto square = addNode(Op::multiply, 0.0, x, x);
+		nodes[index] = { Op::multiply, 0.0, { square, square } };
+	}
+
+	return index;
+}
+
+int ByteCodeOptimiser::addNode(Op op, double value, int x, int y)
+{
+	nodes.push_back({ op, value, { x, y } });
+	return (int)nodes.size() - 1;
+}
+
+bool ByteCodeOptimiser::isConstant(int index, double value) const
+{
+	return nodes[index].op == Op::numberConstant && nodes[index].value == value;
+}
+
+bool ByteCodeOptimiser::isInteger(int index) const
+{
+	switch (nodes[index].op)
+	{
+	case Op::bitnot:
+	case Op::bitand:
+	case Op::bitor:
+	case Op::bitxor:
+	case Op::rshift:
+	case Op::not:
+	case Op::and:
+	case Op::or:
+	case Op::equal:
+	case Op::notequal:
+	case Op::less:
+	case Op::lessorequal:
+	case Op::greater:
+	case Op::greaterorequal:
+		return true;
+
+	// A shifted long can be outside the int range
+	case Op::lshift:
+		return sizeof(long) == sizeof(int);
+
+	case Op::numberConstant:
+	{
+		const auto value = nodes[index].value;
+		return value == std::trunc(value) && !(value == 0 && std::signbit(value))
+			&& value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max();
+	}
+
+	default:
+		return false;
+	}
+}
+
+bool ByteCodeOptimiser::isPure(int index) const
+{
+	const auto& node = nodes[index];
+
+	if (node.op == Op::random) return false;
+
+	for (int i = 0; i < ByteCodeProcessor::tokens[node.op].arity; ++i)
+		if (!isPure(node.operands[i])) return false;
+
+	return true;
+}
+
+int ByteCodeOptimiser::getSize(int index) const
+{
+	const auto& node = nodes[index];
+
+	int size = 1;
+
+	for (int i = 0; i < ByteCodeProcessor::tokens[node.op].arity; ++i)
+		size += getSize(node.operands[i]);
+
+	return size;
+}
+
+void ByteCodeOptimiser::write(int index, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const
+{
+	const auto& node = nodes[index];
+
+	for (int i = 0; i < ByteCodeProcessor::tokens[node.op].arity; ++i)
+		write(node.operands[i], byteCode, numberConstants);
+
+	byteCode.push_back(node.op);
+
+	if (node.op == Op::numberConstant || node.op == Op::cachedValue || node.op == Op::nodeValue)
+		numberConstants.push_back(node.value);
+}
+
+void ByteCodeOptimiser::writeNormalised(int index, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const
+{
+	const auto& node = nodes[index];
+	const auto arity = ByteCodeProcessor::tokens[node.op].arity;
+
+	std::vector<Op> operandCode[2];
+	std::vector<double> operandConstants[2];
+
+	for (int i = 0; i < arity; ++i)
+		writeNormalised(node.operands[i], operandCode[i], operandConstants[i]);
+
+	// Swapping the operands of these ops gives exactly the same result, also for approximate comparisons
+	switch (node.op)
+	{
+	case Op::add:
+	case Op::multiply:
+	case Op::bitand:
+	case Op::bitor:
+	case Op::bitxor:
+	case Op::and:
+	case Op::or:
+	case Op::equal:
+	case Op::notequal:
+		if (std::tie(operandCode[1], operandConstants[1]) < std::tie(operandCode[0], operandConstants[0]))
+		{
+			std::swap(operandCode[0], operandCode[1]);
+			std::swap(operandConstants[0], operandConstants[1]);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	for (int i = 0; i < arity; ++i)
+	{
+		byteCode.insert(byteCode.end(), operandCode[i].begin(), operandCode[i].end());
+		numberConstants.insert(numberConstants.end(), operandConstants[i].begin(), operandConstants[i].end());
+	}
+
+	byteCode.push_back(node.op);
+
+	if (node.op == Op::numberConstant || node.op == Op::cachedValue || node.op == Op::nodeValue)
+		numberConstants.push_back(node.value);
+}
+
+std::vector<ByteCodeOptimiser::Rate> ByteCodeOptimiser::getRates(const std::array<Rate, expr_node_num_ins>& inputRates,
+	const std::vector<Rate>& valueRates) const
+{
+	std::vector<Rate> rates(nodes.size(), Rate::constant);
+
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		const auto& node = nodes[i];
+
+		switch (node.op)
+		{
+		case Op::nf:
+		case Op::sr:
+			rates[i] = Rate::note;
+			break;
+
+		case Op::bps:
+			rates[i] = Rate::block;
+			break;
+
+		case Op::a:
+		case Op::b:
+		case Op::c:
+		case Op::d:
+			rates[i] = inputRates[node.op - Op::a];
+			break;
+
+		case Op::nodeValue:
+			rates[i] = valueRates[(size_t)node.value];
+			break;
+
+		case Op::random:
+		case Op::fs:
+		case Op::f:
+		case Op::ps:
+		case Op::p:
+		case Op::rs:
+		case Op::r:
+		case Op::n:
+		case Op::t:
+		case Op::cachedValue:
+			rates[i] = Rate::sample;
+			break;
+
+		default:
+			for (int j = 0; j < ByteCodeProcessor::tokens[node.op].arity; ++j)
+				rates[i] = juce::jmax(rates[i], rates[node.operands[j]]);
+		}
+	}
+
+	return rates;
+}
+
+void ByteCodeOptimiser::hoistSubexpressions(int index, const std::vector<Rate>& rates, std::vector<HoistedValue>& values)
+{
+	auto& node = nodes[index];
+	const auto arity = ByteCodeProcessor::tokens[node.op].arity;
+
+	// Hoisting a single value wouldn't save anything
+	if (arity == 0) return;
+
+	if (rates[index] != Rate::sample)
+	{
+		// Constant subexpressions are normally folded already, any that are left are evaluated with the note values
+		HoistedValue value{ juce::jmax(rates[index], Rate::note), {}, {} };
+		write(index, value.byteCode, value.numberConstants);
+
+		// Fused programs repeat the subexpressions that several nodes compute, like nf/sr. They are only evaluated once.
+		const auto same = std::find_if(values.begin(), values.end(), [&value](const HoistedValue& other)
+			{
+				return other.byteCode == value.byteCode && other.numberConstants == value.numberConstants;
+			});
+
+		const auto isRepeated = same != values.end();
+
+		node = { Op::cachedValue, (double)(isRepeated ? same - values.begin() : (std::ptrdiff_t)values.size()), { -1, -1 } };
+
+		if (!isRepeated) values.push_back(std::move(value));
+		return;
+	}
+
+	for (int i = 0; i < arity; ++i)
+		hoistSubexpressions(node.operands[i], rates, values);
+}
+
+double ByteCodeOptimiser::evaluate(Op op, double x, double y)
+{
+	switch (op)
+	{
+	case Op::invert: return -x;
+	case Op::add: return x + y;
+	case Op::subtract: return x - y;
+	case Op::multiply: return x * y;
+	case Op::divide: return x / y;
+	case Op::modulo: return std::fmod(x, y);
+
+	case Op::bitnot: return ~(int)x;
+	case Op::bitand: return (int)x & (int)y;
+	case Op::bitor: return (int)x | (int)y;
+	case Op::bitxor: return (int)x ^ (int)y;
+	case Op::lshift: return (double)((long)x << (int)y);
+	case Op::rshift: return (int)x >> (int)y;
+
+	case Op::not: return !(int)x;
+	case Op::and: return (int)x && (int)y;
+	case Op::or: return (int)x || (int)y;
+
+	case Op::less: return x < y;
+	case Op::greater: return x > y;
+
+	case Op::power: return std::pow(x, y);
+
+	case Op::sqrt: return std::sqrt(x);
+	case Op::cbrt: return std::cbrt(x);
+
+	case Op::exp: return std::exp(x);
+	case Op::exp2: return std::exp2(x);
+	case Op::log: return std::log(x);
+	case Op::log2: return std::log2(x);
+	case Op::log10: return std::log10(x);
+
+	case Op::absolute: return std::abs(x);
+
+	case Op::sine: return std::sin(x);
+	case Op::cosine: return std::cos(x);
+	case Op::tangent: return std::tan(x);
+	case Op::arcsine: return std::asin(x);
+	case Op::arccosine: return std::acos(x);
+	case Op::arctangent: return std::atan(x);
+
+	case Op::finite: return std::isinf(x) || std::isnan(x) ? 0.0 : x;
+
+	default:
+		jassertfalse;
+		return 0;
+	}
+}
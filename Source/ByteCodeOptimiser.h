@@ -0,0 +1,83 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "ByteCodeProcessor.h"
+
+// Simplifies the postfix byte code of an expression between parsing and execution.
+// Constant subexpressions and math constants are folded, apart from the comparisons that depend on the math options.
+// Powers with small integer exponents become multiplications, divisions by powers of two become multiplications and
+// identities like x*1 or x|0 are removed.
+// All rewrites give the same results as the original byte code, apart from the rounding of the rewritten powers.
+class ByteCodeOptimiser
+{
+public:
+	using Rate = ByteCodeProcessor::Rate;
+
+	struct HoistedValue
+	{
+		Rate rate;
+		std::vector<ByteCodeProcessor::Op> byteCode;
+		std::vector<double> numberConstants;
+	};
+
+	// Returns the number of ops that were removed
+	static int optimise(std::vector<ByteCodeProcessor::Op>& byteCode, std::vector<double>& numberConstants);
+
+	// Moves the largest subexpressions that change less often than every sample out of the byte code and replaces
+	// them with cachedValue ops. The index of a value in the result is its cachedValue index.
+	// Chains like t*nf/sr*bps are not reordered to make nf/sr*bps hoistable, because that changes the rounding
+	// and a value that is truncated to int afterwards can be off by one.
+	// valueRates are the rates of the values that nodeValue ops read.
+	static std::vector<HoistedValue> hoist(std::vector<ByteCodeProcessor::Op>& byteCode, std::vector<double>& numberConstants,
+		const std::array<Rate, expr_node_num_ins>& inputRates, const std::vector<Rate>& valueRates);
+
+	// Orders the operands of commutative ops, so expressions that only differ in that order get the same byte code.
+	// Only for comparing expressions: with rand ops the reordered code draws the numbers in another order.
+	static void normalise(std::vector<ByteCodeProcessor::Op>& byteCode, std::vector<double>& numberConstants);
+
+	// The rate of the result of the byte code
+	static Rate getRate(const std::vector<ByteCodeProcessor::Op>& byteCode, const std::vector<double>& numberConstants,
+		const std::array<Rate, expr_node_num_ins>& inputRates, const std::vector<Rate>& valueRates);
+
+private:
+	using Op = ByteCodeProcessor::Op;
+
+	// The byte code is turned into a tree. Rewritten powers may use an operand more than once.
+	struct Node
+	{
+		Op op;
+		double value;
+		int operands[2];
+	};
+
+	ByteCodeOptimiser(const std::vector<Op>& byteCode, const std::vector<double>& numberConstants);
+
+	int simplify(int index);
+
+	int simplifyPower(int index);
+
+	int addNode(Op op, double value, int x, int y);
+
+	bool isConstant(int index, double value) const;
+
+	bool isInteger(int index) const;
+
+	bool isPure(int index) const;
+
+	int getSize(int index) const;
+
+	// Operands come before the ops that use them, so the rates can be computed in one pass
+	std::vector<Rate> getRates(const std::array<Rate, expr_node_num_ins>& inputRates, const std::vector<Rate>& valueRates) const;
+
+	void hoistSubexpressions(int index, const std::vector<Rate>& rates, std::vector<HoistedValue>& values);
+
+	void write(int index, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const;
+
+	void writeNormalised(int index, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const;
+
+	static double evaluate(Op op, double x, double y);
+
+	std::vector<Node> nodes;
+	int root = -1;
+};
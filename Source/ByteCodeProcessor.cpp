@@ -1,196 +1,533 @@
 #include "ByteCodeProcessor.h"
 
+#include "ByteCodeOptimiser.h"
+#include "FastMath.h"
+#include "IntegerLanes.h"
+#include "NativeCode.h"
+#include "RandomGenerator.h"
+#include "ThreadedCode.h"
+
+// These have to be here because NativeCode and ThreadedCode are not complete types in the header.
+ByteCodeProcessor::ByteCodeProcessor()
+{
+	inputRates.fill(Rate::sample);
+}
+
+ByteCodeProcessor::~ByteCodeProcessor()
+{}
+
 bool ByteCodeProcessor::update(juce::StringRef exprStr)
 {
 	std::vector<Op> tokenSequence;
 	std::vector<double> nums;
-	int maxStackSize = 0;
 
 	if (!tokenize(exprStr, tokenSequence, nums)) return false;
 
 	// Try to parse as postfix. If it fails, try to convert from infix to postfix, then try to parse as postfix again
 
-	maxStackSize = parsePostfix(tokenSequence);
-	if (maxStackSize == 0)
+	if (parsePostfix(tokenSequence) == 0)
 	{
 		if (!infixToPostfix(tokenSequence)) return false;
 
-		maxStackSize = parsePostfix(tokenSequence);
-		if (maxStackSize == 0) return false;
+		if (parsePostfix(tokenSequence) == 0) return false;
 	}
 
-	processingStack.resize(maxStackSize);
+	setByteCode(tokenSequence, nums);
+
+	return true;
+}
+
+void ByteCodeProcessor::setByteCode(std::vector<Op>& tokenSequence, std::vector<double>& nums)
+{
+	// Rewriting powers can change the stack size
+	const auto numRemoved = ByteCodeOptimiser::optimise(tokenSequence, nums);
+	const auto stackSize = parsePostfix(tokenSequence);
 
 	std::swap(byteCode, tokenSequence);
 	std::swap(numberConstants, nums);
+	maxStackSize = stackSize;
+	numRemovedOps = numRemoved;
 
-	return true;
+	compile();
+}
+
+void ByteCodeProcessor::setInputRates(const std::array<Rate, expr_node_num_ins>& rates)
+{
+	if (rates == inputRates) return;
+
+	inputRates = rates;
+
+	if (!byteCode.empty()) compile();
+}
+
+void ByteCodeProcessor::setMathOptions(const MathOptions& options)
+{
+	if (options == mathOptions) return;
+
+	mathOptions = options;
+
+	if (!byteCode.empty()) compile();
 }
 
-double ByteCodeProcessor::process(const double* inputValues, const GlobalValues globalValues)
+template <typename Sample>
+void ByteCodeProcessor::initialiseFrame(Sample* frame) const
+{
+	const auto& program = getProgram<Sample>();
+
+	// The stack of the native code comes first, the threaded code only needs its registers
+	if (program.threadedCode != nullptr)
+		program.threadedCode->initialiseRegisters(frame + maxStackSize);
+
+	for (const auto& value : program.cachedValues)
+		value.code->initialiseRegisters(frame + value.frameOffset);
+}
+
+template <typename Sample>
+void ByteCodeProcessor::initialiseScratch(Scratch<Sample>& scratch) const
+{
+	scratch.laneStack.resize((size_t)maxStackSize);
+	scratch.laneScratch.resize((size_t)(maxStackSize * max_block_size));
+	scratch.laneIntScratch.resize((size_t)(maxStackSize * max_block_size));
+}
+
+template <typename Sample>
+void ByteCodeProcessor::updateCachedValues(Rate rate, Sample* inputValues, const GlobalValues<Sample>& globalValues,
+	Sample* frame) const
+{
+	const auto& cachedValues = getProgram<Sample>().cachedValues;
+
+	for (size_t i = 0; i < cachedValues.size(); ++i)
+	{
+		const auto& value = cachedValues[i];
+
+		if (value.rate == rate)
+			inputValues[expr_node_num_ins + i] = value.code->run(inputValues, globalValues, frame + value.frameOffset);
+	}
+}
+
+void ByteCodeProcessor::compile()
+{
+	auto sampleCode = byteCode;
+	auto sampleConstants = numberConstants;
+
+	rate = ByteCodeOptimiser::getRate(byteCode, numberConstants, inputRates, valueRates);
+
+	const auto hoistedValues = ByteCodeOptimiser::hoist(sampleCode, sampleConstants, inputRates, valueRates);
+
+	const auto compileProgram = [&](auto& program, auto zero)
+	{
+		using Sample = decltype(zero);
+
+		// If no machine code can be generated, process falls back to interpreting the byte code
+		program.nativeCode = use_native_code ? NativeCode<Sample>::compile(sampleCode, sampleConstants, mathOptions) : nullptr;
+		program.threadedCode = ThreadedCode<Sample>::compile(sampleCode, sampleConstants, mathOptions);
+		program.frameSize = maxStackSize + (program.threadedCode != nullptr ? program.threadedCode->getNumRegisters() : 0);
+
+		program.cachedValues.clear();
+
+		for (const auto& hoisted : hoistedValues)
+		{
+			auto code = ThreadedCode<Sample>::compile(hoisted.byteCode, hoisted.numberConstants, mathOptions);
+			const auto numRegisters = code->getNumRegisters();
+			program.cachedValues.push_back({ hoisted.rate, std::move(code), program.frameSize });
+			program.frameSize += numRegisters;
+		}
+
+		program.integerOps = inferIntegerOps<Sample>(byteCode, numberConstants,
+			std::is_same<Sample, double>::value || mathOptions.exactComparisons);
+	};
+
+	compileProgram(getProgram<double>(), 0.0);
+	compileProgram(getProgram<float>(), 0.0f);
+
+	++version;
+}
+
+template <typename Sample>
+Sample ByteCodeProcessor::process(const Sample* inputValues, const GlobalValues<Sample>& globalValues, Sample* frame) const
 {
 	if (byteCode.empty()) return 0;
 
+	const auto& program = getProgram<Sample>();
+
+	const auto result = program.nativeCode != nullptr
+		? program.nativeCode->run(inputValues, globalValues, frame)
+		: program.threadedCode->run(inputValues, globalValues, frame + maxStackSize);
+
+	return isinf(result) || isnan(result) ? (Sample)0 : result;
+}
+
+template <typename Sample>
+void ByteCodeProcessor::processBlock(const Sample* const* inputValues, const GlobalValueBlock<Sample>& globalValues, Sample* output, int numSamples,
+	Scratch<Sample>& scratch) const
+{
+	if (byteCode.empty())
+	{
+		std::fill(output, output + numSamples, (Sample)0);
+		return;
+	}
+
+	// The lane stack only holds max_block_size samples, so longer blocks are split up
+	for (int offset = 0; offset < numSamples; offset += max_block_size)
+	{
+		processLanes(inputValues, globalValues, offset, output + offset, juce::jmin(max_block_size, numSamples - offset), scratch);
+	}
+}
+
+template <typename Sample>
+void ByteCodeProcessor::processLanes(const Sample* const* inputValues, const GlobalValueBlock<Sample>& globalValues, int offset,
+	Sample* output, int numSamples, Scratch<Sample>& buffers) const
+{
+	const auto& program = getProgram<Sample>();
+	jassert(buffers.laneStack.size() == (size_t)maxStackSize);
+
 	int top = -1;
 
-	auto* codePtr = byteCode.data();
+	auto* lanes = buffers.laneStack.data();
 	auto* numPtr = numberConstants.data();
-	auto* stackPtr = processingStack.data();
 
-	int nextNum = 0;
+	// Every stack level has its own scratch buffers that the result of an op on this level is written to
+	const auto scratch = [&buffers](int level) { return buffers.laneScratch.data() + level * max_block_size; };
+	const auto intScratch = [&buffers](int level) { return buffers.laneIntScratch.data() + level * max_block_size; };
 
+	const auto toSamples = [&](int level)
+	{
+		auto& x = lanes[level];
+		if (!x.isInteger) return;
+
+		auto* data = scratch(level);
+		if (x.uniform)
+			data[0] = (Sample)x.intData[0];
+		else
+			IntegerLanes::toSamples(x.intData, data, numSamples);
+
+		x = { data, nullptr, x.uniform, false };
+	};
 
-	for (const auto op : byteCode)
+	const auto toInteger = [&](int level)
 	{
-		switch (op)
+		auto& x = lanes[level];
+		if (x.isInteger) return;
+
+		auto* data = intScratch(level);
+		if (x.uniform)
+			data[0] = (int)x.data[0];
+		else
+			IntegerLanes::fromSamples(x.data, data, numSamples);
+
+		x = { nullptr, data, x.uniform, true };
+	};
+
+	// The other backends store the results of integer ops as samples. Floats round integers above 2^24,
+	// so int lanes are rounded the same way when an integer op reads them. The exact ints are kept until then,
+	// because results that round to 2^31 have no int and only convert back to the right sample unrounded.
+	const auto toRoundedInteger = [&](int level)
+	{
+		toInteger(level);
+		if (std::is_same<Sample, double>::value) return;
+
+		auto& x = lanes[level];
+		auto* data = intScratch(level);
+		if (x.uniform)
+			data[0] = (int)(Sample)x.intData[0];
+		else
+			IntegerLanes::roundToFloat(x.intData, data, numSamples);
+
+		x.intData = data;
+	};
+
+	const auto pushUniform = [&](Sample value)
+	{
+		++top;
+		auto* data = scratch(top);
+		data[0] = value;
+		lanes[top] = { data, nullptr, true, false };
+	};
+
+	const auto pushUniformInteger = [&](int value)
+	{
+		++top;
+		auto* data = intScratch(top);
+		data[0] = value;
+		lanes[top] = { nullptr, data, true, true };
+	};
+
+	const auto pushArray = [&](const Sample* values)
+	{
+		lanes[++top] = { values + offset, nullptr, false, false };
+	};
+
+	const auto unary = [&](auto&& function)
+	{
+		toSamples(top);
+		applyUnary(function, lanes[top], scratch(top), numSamples);
+	};
+
+	const auto binary = [&](auto&& function)
+	{
+		toSamples(top - 1);
+		toSamples(top);
+		applyBinary(function, lanes[top - 1], lanes[top], scratch(top - 1), numSamples);
+		--top;
+	};
+
+	// The approximations of FastMath have vectorised array versions
+	const auto unaryArray = [&](double (*function)(double), void (*kernel)(const Sample*, Sample*, int))
+	{
+		toSamples(top);
+		auto& x = lanes[top];
+		auto* data = scratch(top);
+
+		if (x.uniform)
+			data[0] = (Sample)function(x.data[0]);
+		else
+			kernel(x.data, data, numSamples);
+
+		x.data = data;
+	};
+
+	const auto binaryArray = [&](double (*function)(double, double),
+		void (*kernel)(const Sample*, bool, const Sample*, bool, Sample*, int))
+	{
+		toSamples(top - 1);
+		toSamples(top);
+		auto& x = lanes[top - 1];
+		const auto& y = lanes[top];
+		auto* data = scratch(top - 1);
+
+		if (x.uniform && y.uniform)
+			data[0] = (Sample)function(x.data[0], y.data[0]);
+		else
+			kernel(x.data, x.uniform, y.data, y.uniform, data, numSamples);
+
+		x = { data, nullptr, x.uniform && y.uniform, false };
+		--top;
+	};
+
+	const auto polynomial = mathOptions.precision != Precision::exact;
+	const auto table = mathOptions.precision == Precision::table;
+	const auto exactComparisons = mathOptions.exactComparisons;
+
+	const auto unaryInteger = [&](int (*function)(int), void (*kernel)(const int*, int*, int))
+	{
+		toRoundedInteger(top);
+		auto& x = lanes[top];
+		auto* data = intScratch(top);
+
+		if (x.uniform)
+			data[0] = function(x.intData[0]);
+		else
+			kernel(x.intData, data, numSamples);
+
+		x.intData = data;
+	};
+
+	const auto binaryInteger = [&](IntegerLanes::Operation operation)
+	{
+		toRoundedInteger(top - 1);
+		toRoundedInteger(top);
+		auto& x = lanes[top - 1];
+		const auto& y = lanes[top];
+		auto* data = intScratch(top - 1);
+
+		if (x.uniform && y.uniform)
+			data[0] = IntegerLanes::apply(operation, x.intData[0], y.intData[0]);
+		else
+			IntegerLanes::binary(operation, x.intData, x.uniform, y.intData, y.uniform, data, numSamples);
+
+		x = { nullptr, data, x.uniform && y.uniform, true };
+		--top;
+	};
+
+	for (size_t i = 0; i < byteCode.size(); ++i)
+	{
+		// Whether the op was proven to have an integer result by inferIntegerOps
+		const bool integer = program.integerOps[i];
+
+		switch (byteCode[i])
 		{
-		case invert: stackPtr[top] = -stackPtr[top];
+		case invert: unary([](Sample x) { return -x; });
 			break;
-		case add: jassert(top >= 1);
-			stackPtr[top - 1] = stackPtr[top - 1] + stackPtr[top];
-			--top;
+		case add: binary([](Sample x, Sample y) { return x + y; });
 			break;
-		case subtract: stackPtr[top - 1] = stackPtr[top - 1] - stackPtr[top];
-			--top;
+		case subtract: binary([](Sample x, Sample y) { return x - y; });
 			break;
-		case multiply: stackPtr[top - 1] = stackPtr[top - 1] * stackPtr[top];
-			--top;
+		case multiply: binary([](Sample x, Sample y) { return x * y; });
 			break;
-		case divide: stackPtr[top - 1] = stackPtr[top - 1] / stackPtr[top];
-			--top;
+		case divide: binary([](Sample x, Sample y) { return x / y; });
 			break;
-
-			//case modulo:  if ((int)stackPtr[top]) stackPtr[top - 1] = (int)stackPtr[top - 1] % (int)stackPtr[top]; else return 0; --top; break;
-		case modulo: stackPtr[top - 1] = std::fmod(stackPtr[top - 1], stackPtr[top]);
-			--top;
+		case modulo: binary([](Sample x, Sample y) { return std::fmod(x, y); });
 			break;
 
-		case bitnot: stackPtr[top] = ~(int)stackPtr[top];
+		case bitnot: unaryInteger([](int x) { return ~x; }, IntegerLanes::bitNot);
 			break;
-		case bitand: stackPtr[top - 1] = (int)stackPtr[top - 1] & (int)stackPtr[top];
-			--top;
+		case bitand: binaryInteger(IntegerLanes::bitAnd);
 			break;
-		case bitor : stackPtr[top - 1] = (int)stackPtr[top - 1] | (int)stackPtr[top];
-			--top;
+		case bitor : binaryInteger(IntegerLanes::bitOr);
 			break;
-		case bitxor: stackPtr[top - 1] = (int)stackPtr[top - 1] ^ (int)stackPtr[top];
-			--top;
+		case bitxor: binaryInteger(IntegerLanes::bitXor);
 			break;
-		case lshift: stackPtr[top - 1] = (long)stackPtr[top - 1] << (int)stackPtr[top];
-			--top;
+		case lshift:
+			if (integer) binaryInteger(IntegerLanes::leftShift);
+			else binary([](Sample x, Sample y) { return (Sample)((long)x << (int)y); });
 			break;
-		case rshift: stackPtr[top - 1] = (int)stackPtr[top - 1] >> (int)stackPtr[top];
-			--top;
+		case rshift: binaryInteger(IntegerLanes::rightShift);
 			break;
 
-		case not: stackPtr[top] = !(int)stackPtr[top];
+		case not: unaryInteger([](int x) { return (int)!x; }, IntegerLanes::logicalNot);
 			break;
-		case and: stackPtr[top - 1] = (int)stackPtr[top - 1] && (int)stackPtr[top];
-			--top;
+		case and: binaryInteger(IntegerLanes::logicalAnd);
 			break;
-		case or : stackPtr[top - 1] = (int)stackPtr[top - 1] || (int)stackPtr[top];
-			--top;
+		case or : binaryInteger(IntegerLanes::logicalOr);
 			break;
 
-		case equal: stackPtr[top - 1] = juce::approximatelyEqual(stackPtr[top - 1], stackPtr[top]);
-			--top;
+		case equal:
+			if (integer) binaryInteger(IntegerLanes::equal);
+			else if (exactComparisons) binary([](Sample x, Sample y) { return (Sample)(x == y); });
+			else binary([](Sample x, Sample y) { return (Sample)juce::approximatelyEqual(x, y); });
 			break;
-		case notequal: stackPtr[top - 1] = !juce::approximatelyEqual(stackPtr[top - 1], stackPtr[top]);
-			--top;
+		case notequal:
+			if (integer) binaryInteger(IntegerLanes::notEqual);
+			else if (exactComparisons) binary([](Sample x, Sample y) { return (Sample)(x != y); });
+			else binary([](Sample x, Sample y) { return (Sample)!juce::approximatelyEqual(x, y); });
 			break;
-		case less: stackPtr[top - 1] = stackPtr[top - 1] < stackPtr[top];
-			--top;
+		case less:
+			if (integer) binaryInteger(IntegerLanes::less);
+			else binary([](Sample x, Sample y) { return (Sample)(x < y); });
 			break;
-		case lessorequal: stackPtr[top - 1] = stackPtr[top - 1] < stackPtr[top] || juce::approximatelyEqual(stackPtr[top - 1], stackPtr[top]);
-			--top;
+		case lessorequal:
+			if (integer) binaryInteger(IntegerLanes::lessOrEqual);
+			else if (exactComparisons) binary([](Sample x, Sample y) { return (Sample)(x <= y); });
+			else binary([](Sample x, Sample y) { return (Sample)(x < y || juce::approximatelyEqual(x, y)); });
 			break;
-		case greater: stackPtr[top - 1] = stackPtr[top - 1] > stackPtr[top];
-			--top;
+		case greater:
+			if (integer) binaryInteger(IntegerLanes::greater);
+			else binary([](Sample x, Sample y) { return (Sample)(x > y); });
 			break;
-		case greaterorequal: stackPtr[top - 1] = stackPtr[top - 1] > stackPtr[top] || juce::approximatelyEqual(stackPtr[top - 1], stackPtr[top]);
-			--top;
+		case greaterorequal:
+			if (integer) binaryInteger(IntegerLanes::greaterOrEqual);
+			else if (exactComparisons) binary([](Sample x, Sample y) { return (Sample)(x >= y); });
+			else binary([](Sample x, Sample y) { return (Sample)(x > y || juce::approximatelyEqual(x, y)); });
 			break;
 
-		case power: stackPtr[top - 1] = std::pow(stackPtr[top - 1], stackPtr[top]);
-			--top;
+		case power:
+			if (polynomial) binaryArray(FastMath::power, FastMath::power);
+			else binary([](Sample x, Sample y) { return std::pow(x, y); });
 			break;
 
-		case sqrt: stackPtr[top] = std::sqrt(stackPtr[top]);
+		case sqrt: unary([](Sample x) { return std::sqrt(x); });
 			break;
-		case cbrt: stackPtr[top] = std::cbrt(stackPtr[top]);
+		case cbrt: unary([](Sample x) { return std::cbrt(x); });
 			break;
 
-		case exp: stackPtr[top] = std::exp(stackPtr[top]);
+		case exp:
+			if (polynomial) unaryArray(FastMath::exp, FastMath::exp);
+			else unary([](Sample x) { return std::exp(x); });
 			break;
-		case exp2: stackPtr[top] = std::exp2(stackPtr[top]);
+		case exp2:
+			if (polynomial) unaryArray(FastMath::exp2, FastMath::exp2);
+			else unary([](Sample x) { return std::exp2(x); });
 			break;
-		case log: stackPtr[top] = std::log(stackPtr[top]);
+		case log:
+			if (polynomial) unaryArray(FastMath::log, FastMath::log);
+			else unary([](Sample x) { return std::log(x); });
 			break;
-		case log2: stackPtr[top] = std::log2(stackPtr[top]);
+		case log2:
+			if (polynomial) unaryArray(FastMath::log2, FastMath::log2);
+			else unary([](Sample x) { return std::log2(x); });
 			break;
-		case log10: stackPtr[top] = std::log10(stackPtr[top]);
+		case log10:
+			if (polynomial) unaryArray(FastMath::log10, FastMath::log10);
+			else unary([](Sample x) { return std::log10(x); });
 			break;
 
+		case absolute: unary([](Sample x) { return std::abs(x); });
+			break;
 
-		case sine: stackPtr[top] = std::sin(stackPtr[top]);
+		case sine:
+			if (table) unaryArray(FastMath::tableSine, FastMath::tableSine);
+			else if (polynomial) unaryArray(FastMath::sine, FastMath::sine);
+			else unary([](Sample x) { return std::sin(x); });
 			break;
-		case cosine: stackPtr[top] = std::cos(stackPtr[top]);
+		case cosine:
+			if (table) unaryArray(FastMath::tableCosine, FastMath::tableCosine);
+			else if (polynomial) unaryArray(FastMath::cosine, FastMath::cosine);
+			else unary([](Sample x) { return std::cos(x); });
 			break;
-		case tangent: stackPtr[top] = std::tan(stackPtr[top]);
+		case tangent:
+			if (table) unaryArray(FastMath::tableTangent, FastMath::tableTangent);
+			else if (polynomial) unaryArray(FastMath::tangent, FastMath::tangent);
+			else unary([](Sample x) { return std::tan(x); });
 			break;
-		case arcsine: stackPtr[top] = std::asin(stackPtr[top]);
+		case arcsine: unary([](Sample x) { return std::asin(x); });
 			break;
-		case arccosine: stackPtr[top] = std::acos(stackPtr[top]);
+		case arccosine: unary([](Sample x) { return std::acos(x); });
 			break;
-		case arctangent: stackPtr[top] = std::atan(stackPtr[top]);
+		case arctangent: unary([](Sample x) { return std::atan(x); });
 			break;
 
-		case numberConstant: stackPtr[++top] = numberConstants[nextNum++];
+		case numberConstant:
+			if (integer) pushUniformInteger((int)(Sample)*numPtr++);
+			else pushUniform((Sample)*numPtr++);
 			break;
 
-		case pi: stackPtr[++top] = juce::MathConstants<double>::pi;
+		case pi: pushUniform((Sample)juce::MathConstants<double>::pi);
 			break;
-		case twopi: stackPtr[++top] = juce::MathConstants<double>::twoPi;
+		case twopi: pushUniform((Sample)juce::MathConstants<double>::twoPi);
 			break;
-		case halfpi: stackPtr[++top] = juce::MathConstants<double>::halfPi;
+		case halfpi: pushUniform((Sample)juce::MathConstants<double>::halfPi);
 			break;
-		case e: stackPtr[++top] = juce::MathConstants<double>::euler;
+		case e: pushUniform((Sample)juce::MathConstants<double>::euler);
 			break;
 
-		case random: stackPtr[++top] = (double)std::rand() / RAND_MAX;
+		case random:
+		{
+			++top;
+			auto* data = scratch(top);
+			globalValues.random->fill(data, numSamples);
+			lanes[top] = { data, nullptr, false, false };
 			break;
+		}
 
-		case fs: stackPtr[++top] = globalValues.fs;
+		case fs: pushArray(globalValues.fs);
 			break;
-		case f: stackPtr[++top] = globalValues.f;
+		case f: pushArray(globalValues.f);
 			break;
-		case ps: stackPtr[++top] = globalValues.ps;
+		case ps: pushArray(globalValues.ps);
 			break;
-		case p: stackPtr[++top] = globalValues.p;
+		case p: pushArray(globalValues.p);
 			break;
-		case rs: stackPtr[++top] = globalValues.rs;
+		case rs: pushArray(globalValues.rs);
 			break;
-		case r: stackPtr[++top] = globalValues.r;
+		case r: pushArray(globalValues.r);
 			break;
-		case n: stackPtr[++top] = globalValues.n;
+		case n: pushArray(globalValues.n);
 			break;
-		case t: stackPtr[++top] = globalValues.t;
+		case t: pushArray(globalValues.t);
 			break;
 
-		case nf: stackPtr[++top] = globalValues.nf;
+		case nf: pushArray(globalValues.nf);
 			break;
-		case sr: stackPtr[++top] = globalValues.sr;
+		case sr: pushUniform(globalValues.sr);
 			break;
-		case bps: stackPtr[++top] = globalValues.bps;
+		case bps: pushUniform(globalValues.bps);
 			break;
 
-		case a: stackPtr[++top] = inputValues[0];
+		case a: pushArray(inputValues[0]);
+			break;
+		case b: pushArray(inputValues[1]);
+			break;
+		case c: pushArray(inputValues[2]);
 			break;
-		case b: stackPtr[++top] = inputValues[1];
+		case d: pushArray(inputValues[3]);
 			break;
-		case c: stackPtr[++top] = inputValues[2];
+
+		case nodeValue: pushArray(globalValues.values[(int)*numPtr++]);
 			break;
-		case d: stackPtr[++top] = inputValues[3];
+
+		// Integers are always finite
+		case finite:
+			if (!integer) unary([](Sample x) { return isinf(x) || isnan(x) ? (Sample)0 : x; });
 			break;
 
 		case lparenthesis: break;
@@ -198,14 +535,74 @@ double ByteCodeProcessor::process(const double* inputValues, const GlobalValues
 		case error: break;
 		default:;
 		}
-		jassert(top >= 0 && top < processingStack.size());
 	}
 
-	const auto result = processingStack[top];
+	jassert(top == 0);
+
+	toSamples(top);
+	const auto result = lanes[top];
+
+	for (int i = 0; i < numSamples; ++i)
+	{
+		const auto value = result.data[result.uniform ? 0 : i];
+		output[i] = isinf(value) || isnan(value) ? (Sample)0 : value;
+	}
+}
+
+template <typename Sample, typename Function>
+void ByteCodeProcessor::applyUnary(Function&& function, Lanes<Sample>& x, Sample* scratch, int numSamples)
+{
+	if (x.uniform)
+	{
+		scratch[0] = function(x.data[0]);
+	}
+	else
+	{
+		for (int i = 0; i < numSamples; ++i)
+			scratch[i] = function(x.data[i]);
+	}
+
+	x = { scratch, nullptr, x.uniform, false };
+}
+
+template <typename Sample, typename Function>
+void ByteCodeProcessor::applyBinary(Function&& function, Lanes<Sample>& x, const Lanes<Sample>& y, Sample* scratch, int numSamples)
+{
+	if (x.uniform && y.uniform)
+	{
+		scratch[0] = function(x.data[0], y.data[0]);
+	}
+	else if (x.uniform)
+	{
+		const auto xValue = x.data[0];
+		for (int i = 0; i < numSamples; ++i)
+			scratch[i] = function(xValue, y.data[i]);
+	}
+	else if (y.uniform)
+	{
+		const auto yValue = y.data[0];
+		for (int i = 0; i < numSamples; ++i)
+			scratch[i] = function(x.data[i], yValue);
+	}
+	else
+	{
+		for (int i = 0; i < numSamples; ++i)
+			scratch[i] = function(x.data[i], y.data[i]);
+	}
 
-	return isinf(result) || isnan(result) ? 0.0 : result;
+	x = { scratch, nullptr, x.uniform && y.uniform, false };
 }
 
+#define BBGRAPH_SAMPLE_FUNCTIONS(Sample) \
+	template void ByteCodeProcessor::initialiseFrame(Sample*) const; \
+	template void ByteCodeProcessor::initialiseScratch(Scratch<Sample>&) const; \
+	template void ByteCodeProcessor::updateCachedValues(Rate, Sample*, const GlobalValues<Sample>&, Sample*) const; \
+	template Sample ByteCodeProcessor::process(const Sample*, const GlobalValues<Sample>&, Sample*) const; \
+	template void ByteCodeProcessor::processBlock(const Sample* const*, const GlobalValueBlock<Sample>&, Sample*, int, Scratch<Sample>&) const;
+
+BBGRAPH_SAMPLE_FUNCTIONS(double)
+BBGRAPH_SAMPLE_FUNCTIONS(float)
+
 ByteCodeProcessor::Op ByteCodeProcessor::getTokenFromString(std::string const& buffer)
 {
 	for (const auto& p : tokens)
@@ -402,6 +799,84 @@ int ByteCodeProcessor::parsePostfix(const std::vector<Op>& tokenSequence)
 	return false;
 }
 
+template <typename Sample>
+std::vector<bool> ByteCodeProcessor::inferIntegerOps(const std::vector<Op>& tokenSequence, const std::vector<double>& numberConstants,
+	bool integerComparisons)
+{
+	std::vector<bool> integerOps(tokenSequence.size());
+
+	// Whether each value on the stack is known to be an integer
+	std::vector<bool> stack;
+	int nextNum = 0;
+
+	for (size_t i = 0; i < tokenSequence.size(); ++i)
+	{
+		const auto op = tokenSequence[i];
+		const auto arity = tokens[op].arity;
+
+		bool integer = false;
+
+		switch (op)
+		{
+		// These cast their operands to int, so they can work on int lanes directly
+		case bitnot:
+		case bitand:
+		case bitor:
+		case bitxor:
+		case rshift:
+		case not:
+		case and:
+		case or:
+			integer = true;
+			break;
+
+		// The interpreter shifts a long. This only wraps around like an int32 if long is 32 bits wide.
+		case lshift:
+			integer = sizeof(long) == sizeof(int);
+			break;
+
+		// Comparisons of two integers can be done on int lanes
+		case equal:
+		case notequal:
+		case lessorequal:
+		case greaterorequal:
+			integer = integerComparisons && stack[stack.size() - 1] && stack[stack.size() - 2];
+			break;
+
+		case less:
+		case greater:
+			integer = stack[stack.size() - 1] && stack[stack.size() - 2];
+			break;
+
+		case finite:
+			integer = stack.back();
+			break;
+
+		case nodeValue:
+			++nextNum;
+			break;
+
+		case numberConstant:
+		{
+			// The lanes push the constant rounded to Sample, 2147483647 becomes 2^31 as a float
+			const auto value = (double)(Sample)numberConstants[nextNum++];
+			integer = value == std::trunc(value) && !(value == 0 && std::signbit(value))
+				&& value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max();
+			break;
+		}
+
+		default:;
+		}
+
+		stack.resize(stack.size() - arity);
+		stack.push_back(integer);
+
+		integerOps[i] = integer;
+	}
+
+	return integerOps;
+}
+
 bool ByteCodeProcessor::infixToPostfix(std::vector<Op>& tokenSequence) const
 {
 	std::vector<Op> postfix;
@@ -2,24 +2,71 @@
 
 #include <JuceHeader.h>
 
+#include "Defines.h"
+
+class RandomGenerator;
+
+// Expressions are evaluated with doubles or floats, Sample is one of them
+template <typename Sample>
 struct GlobalValues
 {
-	double fs;
-	double f;
-	double ps;
-	double p;
-	double rs;
-	double r;
-	double n;
-	double t;
-
-	double nf;
-	double sr;
-	double bps;
+	Sample fs;
+	Sample f;
+	Sample ps;
+	Sample p;
+	Sample rs;
+	Sample r;
+	Sample n;
+	Sample t;
+
+	Sample nf;
+	Sample sr;
+	Sample bps;
+
+	// The generator of the voice, for the rand op
+	RandomGenerator* random = nullptr;
+
+	// The values of the other programs of a fused graph, for the nodeValue op
+	const Sample* values = nullptr;
+};
+
+// The global values for a block of lanes, which are either the samples of a block or the voices that are evaluated
+// together. The time variables and nf are passed as arrays, the others are the same in every lane.
+template <typename Sample>
+struct GlobalValueBlock
+{
+	const Sample* fs;
+	const Sample* f;
+	const Sample* ps;
+	const Sample* p;
+	const Sample* rs;
+	const Sample* r;
+	const Sample* n;
+	const Sample* t;
+	const Sample* nf;
+
+	Sample sr;
+	Sample bps;
+
+	// Draws the random numbers of all lanes
+	RandomGenerator* random = nullptr;
+
+	// One array per value of a fused graph
+	const Sample* const* values = nullptr;
 };
 
+class ByteCodeOptimiser;
+class FusedGraph;
+template <typename Sample> class NativeCode;
+template <typename Sample> class ThreadedCode;
+
 class ByteCodeProcessor
 {
+	friend class ByteCodeOptimiser;
+	friend class FusedGraph;
+	template <typename Sample> friend class NativeCode;
+	template <typename Sample> friend class ThreadedCode;
+
 	enum Op
 	{
 		invert,
@@ -94,6 +141,10 @@ class ByteCodeProcessor
 		c,
 		d,
 
+		cachedValue,
+		nodeValue,
+		finite,
+
 		lparenthesis,
 		rparenthesis,
 
@@ -189,6 +240,15 @@ class ByteCodeProcessor
 		{"c", c, 0, none, 0},
 		{"d", d, 0, none, 0},
 
+		// Reads a hoisted subexpression. Like numberConstant it takes the next constant, which is the index of the value.
+		{"", cachedValue, 0, none, 0},
+
+		// Reads the value of another program of a fused graph. Takes the next constant, which is the index of the value.
+		{"", nodeValue, 0, none, 0},
+
+		// Replaces infinity and NaN with 0, like process does with the result. Fused graphs apply it to the expressions
+		// they inline, so the expressions that read them see the same values as before.
+		{"", finite, 2, right, 1},
 
 		{"(", lparenthesis, 0, none, -1},
 		{")", rparenthesis, 0, none, -1}
@@ -198,12 +258,162 @@ class ByteCodeProcessor
 
 	enum State { newToken, minusRead, readNumber, readWord, readSymbols };
 
+	template <typename Sample> struct Lanes;
+
 public:
+	// How often a value can change
+	enum class Rate { constant, note, block, sample };
+
+	// How the transcendental ops are evaluated. exact calls the standard library, polynomial and table use the
+	// approximations of FastMath, whose error bounds are listed there. Only the trigonometric ops have tables,
+	// the others are evaluated with polynomials in the table mode.
+	enum class Precision { exact, polynomial, table };
+
+	struct MathOptions
+	{
+		Precision precision = Precision::exact;
+
+		// Compare doubles with == and friends instead of juce::approximatelyEqual
+		bool exactComparisons = false;
+
+		bool operator==(const MathOptions& other) const
+		{
+			return precision == other.precision && exactComparisons == other.exactComparisons;
+		}
+
+		bool operator!=(const MathOptions& other) const { return !(*this == other); }
+	};
+
+	ByteCodeProcessor();
+	~ByteCodeProcessor();
+
 	bool update(juce::StringRef exprStr);
 
-	double process(const double* inputValues, const GlobalValues globalValues);
-	
+	// Subexpressions that only depend on inputs with a rate below sample are hoisted too. All inputs have sample rate
+	// by default. Recompiles the expression if the rates change.
+	void setInputRates(const std::array<Rate, expr_node_num_ins>& rates);
+
+	// Recompiles the expression if the options change
+	void setMathOptions(const MathOptions& options);
+
+	// The expression is compiled for both sample types, so each voice can use either. Floats halve the size of the
+	// values and double the width of the block kernels, but integers above 2^24 lose their lowest bits.
+
+	// The processor only holds the compiled code and isn't changed by evaluating it, so any number of callers can
+	// evaluate it at the same time, like voices that render in parallel. Each of them passes the memory the code
+	// works in, the random numbers come from the generator in the global values.
+
+	// process and updateCachedValues work in a frame of getFrameSize values, the stack and the registers of the code.
+	// A frame can be part of a larger allocation, like the arena of a voice.
+	template <typename Sample>
+	int getFrameSize() const { return getProgram<Sample>().frameSize; }
+
+	// Writes the constants of the code into a frame. run never overwrites them, so this is only done once per version.
+	template <typename Sample>
+	void initialiseFrame(Sample* frame) const;
+
+	// The buffers processBlock works in
+	template <typename Sample>
+	struct Scratch
+	{
+		std::vector<Lanes<Sample>> laneStack;
+		std::vector<Sample> laneScratch;
+		std::vector<int> laneIntScratch;
+	};
+
+	// Sizes scratch buffers for the current version of the expression. They have to be sized again when the version changes.
+	template <typename Sample>
+	void initialiseScratch(Scratch<Sample>& scratch) const;
+
+	// Evaluates the hoisted subexpressions of a rate. Their values are stored after the inputs, so inputValues
+	// has to hold expr_node_num_ins + getNumCachedValues() values. The block values may use the inputs.
+	template <typename Sample>
+	void updateCachedValues(Rate rate, Sample* inputValues, const GlobalValues<Sample>& globalValues, Sample* frame) const;
+
+	// The number of hoisted subexpressions, which changes when the expression is compiled again
+	int getNumCachedValues() const { return (int)std::get<Program<double>>(programs).cachedValues.size(); }
+
+	// The deepest the stack gets while the expression is evaluated, known when it is parsed
+	int getStackSize() const { return maxStackSize; }
+
+	// Changes whenever the expression is compiled again. All cached values have to be updated then.
+	int getVersion() const { return version; }
+
+	// How often the result can change, given the rates of the inputs
+	Rate getRate() const { return rate; }
+
+	// inputValues has to contain the cached values
+	template <typename Sample>
+	Sample process(const Sample* inputValues, const GlobalValues<Sample>& globalValues, Sample* frame) const;
+
+	// Evaluates the expression for numSamples lanes at once. inputValues holds one array per input.
+	// The values of a fused graph are read from globalValues.values.
+	template <typename Sample>
+	void processBlock(const Sample* const* inputValues, const GlobalValueBlock<Sample>& globalValues, Sample* output, int numSamples,
+		Scratch<Sample>& scratch) const;
+
+	// Whether the expression draws random numbers. How many it draws from which generator depends on how it is evaluated.
+	bool usesRandom() const { return std::find(byteCode.begin(), byteCode.end(), random) != byteCode.end(); }
+
+	// The number of ops the optimiser removed from the last valid expression
+	int getNumRemovedOps() const { return numRemovedOps; }
+
 private:
+	// A stack entry of the block processor. Uniform entries hold the same value for every sample of the block,
+	// so only the first value is valid and it is computed once.
+	// Integer entries hold int32 values in intData instead of samples in data.
+	template <typename Sample>
+	struct Lanes
+	{
+		const Sample* data;
+		const int* intData;
+		bool uniform;
+		bool isInteger;
+	};
+
+	template <typename Sample>
+	struct CachedValue
+	{
+		Rate rate;
+		std::unique_ptr<ThreadedCode<Sample>> code;
+
+		// Where the registers of the code start in a frame
+		int frameOffset;
+	};
+
+	// The code for evaluating the expression with one sample type
+	template <typename Sample>
+	struct Program
+	{
+		std::vector<CachedValue<Sample>> cachedValues;
+
+		// The code for a sample, with the hoisted subexpressions replaced by cachedValue ops
+		std::unique_ptr<NativeCode<Sample>> nativeCode;
+		std::unique_ptr<ThreadedCode<Sample>> threadedCode;
+
+		// A frame holds the stack of the native code, then the registers of the threaded code and of the cached values
+		int frameSize = 0;
+
+		std::vector<bool> integerOps;
+	};
+
+	template <typename Sample>
+	Program<Sample>& getProgram() { return std::get<Program<Sample>>(programs); }
+
+	template <typename Sample>
+	const Program<Sample>& getProgram() const { return std::get<Program<Sample>>(programs); }
+
+	template <typename Sample>
+	void processLanes(const Sample* const* inputValues, const GlobalValueBlock<Sample>& globalValues, int offset, Sample* output, int numSamples,
+		Scratch<Sample>& scratch) const;
+
+	template <typename Sample, typename Function>
+	static void applyUnary(Function&& function, Lanes<Sample>& x, Sample* scratch, int numSamples);
+
+	template <typename Sample, typename Function>
+	static void applyBinary(Function&& function, Lanes<Sample>& x, const Lanes<Sample>& y, Sample* scratch, int numSamples);
+
+
 	static Op getTokenFromString(std::string const& buffer);
 
 	static bool tokenize(juce::StringRef expressionString, std::vector<Op>& tokenSequence,
@@ -213,7 +423,31 @@ private:
 
 	bool infixToPostfix(std::vector<Op>& tokenSequence) const;
 
+	// Optimises and compiles valid postfix byte code
+	void setByteCode(std::vector<Op>& tokenSequence, std::vector<double>& nums);
+
+	// Hoists the invariant subexpressions of byteCode and compiles the programs that process runs
+	void compile();
+
+	// Finds the ops of a postfix sequence that have integer results and can be evaluated on int32 lanes.
+	// Approximate comparisons of floats treat neighbouring integers above 2^23 as equal, so they are only
+	// done on int lanes if integerComparisons is set. Constants are checked after they are rounded to Sample.
+	template <typename Sample>
+	static std::vector<bool> inferIntegerOps(const std::vector<Op>& tokenSequence, const std::vector<double>& numberConstants,
+		bool integerComparisons);
+
 	std::vector<Op> byteCode;
 	std::vector<double> numberConstants;
-	std::vector<double> processingStack;
-};
+	int maxStackSize = 0;
+	int numRemovedOps = 0;
+
+	std::array<Rate, expr_node_num_ins> inputRates;
+
+	// The rates of the values a fused program reads with nodeValue
+	std::vector<Rate> valueRates;
+
+	MathOptions mathOptions;
+	std::tuple<Program<double>, Program<float>> programs;
+	int version = 0;
+	Rate rate = Rate::constant;
+};
\ No newline at end of file
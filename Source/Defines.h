@@ -1,7 +1,42 @@
 #pragma once
 
+#include <JuceHeader.h>
+
+// The AVX2 kernels are compiled on intel, with BBGRAPH_AVX2_TARGET on each function that uses AVX2 instructions,
+// and only run if hasAVX2. MSVC compiles the intrinsics without a target attribute.
+#if JUCE_INTEL
+#include <immintrin.h>
+#define BBGRAPH_AVX2 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define BBGRAPH_AVX2_TARGET
+#else
+#define BBGRAPH_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#else
+#define BBGRAPH_AVX2 0
+#endif
+
+// Whether the AVX2 kernels can run, looked up once
+inline bool hasAVX2()
+{
+#if BBGRAPH_AVX2
+	static const bool supported = juce::SystemStats::hasAVX2();
+	return supported;
+#else
+	return false;
+#endif
+}
+
 constexpr int expr_node_num_ins = 4;
 
 constexpr int total_num_params = 64;
 
 constexpr int total_num_voices = 8;
+
+constexpr int max_block_size = 128;
+
+// The most voices that are evaluated together, in the lanes of the block kernels
+constexpr int max_voice_lanes = 8;
+
+// Compile expressions to machine code where the platform supports it
+constexpr bool use_native_code = true;
@@ -0,0 +1,354 @@
+#include "FastMath.h"
+
+#include "Defines.h"
+
+const std::array<double, FastMath::tableSize + 1> FastMath::sineTable = []
+{
+	std::array<double, tableSize + 1> table;
+
+	for (int i = 0; i < tableSize; ++i)
+		table[i] = std::sin(i * juce::MathConstants<double>::twoPi / tableSize);
+
+	table[tableSize] = table[0];
+
+	return table;
+}();
+
+#if BBGRAPH_AVX2
+
+#pragma region Vector
+
+// The functions of FastMath on 4 lanes. Comparisons give masks that select between results computed for all lanes,
+// so nothing branches.
+struct FastMath::Vector
+{
+	BBGRAPH_AVX2_TARGET static __m256d broadcast(double x) { return _mm256_set1_pd(x); }
+
+	BBGRAPH_AVX2_TARGET static __m256d fromBits(__m256i bits) { return _mm256_castsi256_pd(bits); }
+	BBGRAPH_AVX2_TARGET static __m256i toBits(__m256d x) { return _mm256_castpd_si256(x); }
+
+	// mask ? a : b
+	BBGRAPH_AVX2_TARGET static __m256d select(__m256d mask, __m256d a, __m256d b) { return _mm256_blendv_pd(b, a, mask); }
+
+	BBGRAPH_AVX2_TARGET static __m256d negate(__m256d x) { return _mm256_xor_pd(x, broadcast(-0.0)); }
+	BBGRAPH_AVX2_TARGET static __m256d absolute(__m256d x) { return _mm256_andnot_pd(broadcast(-0.0), x); }
+
+	// Whether bit is set in bits, as a mask
+	BBGRAPH_AVX2_TARGET static __m256d isSet(__m256i bits, juce::int64 bit)
+	{
+		const auto b = _mm256_set1_epi64x(bit);
+		return fromBits(_mm256_cmpeq_epi64(_mm256_and_si256(bits, b), b));
+	}
+
+	template <size_t numCoefficients>
+	BBGRAPH_AVX2_TARGET static __m256d polynomial(__m256d x, const double (&coefficients)[numCoefficients])
+	{
+		auto result = broadcast(coefficients[0]);
+
+		for (size_t i = 1; i < numCoefficients; ++i)
+			result = _mm256_add_pd(broadcast(coefficients[i]), _mm256_mul_pd(x, result));
+
+		return result;
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d reduce(__m256d x, __m256i& quadrant)
+	{
+		const auto shifted = _mm256_add_pd(_mm256_mul_pd(x, broadcast(twoOverPi)), broadcast(roundingConstant));
+		const auto q = _mm256_sub_pd(shifted, broadcast(roundingConstant));
+		quadrant = toBits(shifted);
+
+		auto r = _mm256_sub_pd(x, _mm256_mul_pd(q, broadcast(halfPi1)));
+		r = _mm256_sub_pd(r, _mm256_mul_pd(q, broadcast(halfPi2)));
+		return _mm256_sub_pd(r, _mm256_mul_pd(q, broadcast(halfPi3)));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d sinePolynomial(__m256d r, __m256d r2)
+	{
+		return _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(r, r2), polynomial(r2, sineCoefficients)));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d cosinePolynomial(__m256d r2)
+	{
+		return _mm256_add_pd(broadcast(1.0), _mm256_mul_pd(r2, polynomial(r2, cosineCoefficients)));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d sineOfQuadrant(__m256d x, juce::int64 quadrantOffset)
+	{
+		__m256i quadrant;
+		const auto r = reduce(x, quadrant);
+		quadrant = _mm256_add_epi64(quadrant, _mm256_set1_epi64x(quadrantOffset));
+		const auto r2 = _mm256_mul_pd(r, r);
+
+		const auto value = select(isSet(quadrant, 1), cosinePolynomial(r2), sinePolynomial(r, r2));
+		const auto sign = _mm256_slli_epi64(_mm256_and_si256(quadrant, _mm256_set1_epi64x(2)), 62);
+
+		return _mm256_xor_pd(value, fromBits(sign));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d sine(__m256d x) { return sineOfQuadrant(x, 0); }
+	BBGRAPH_AVX2_TARGET static __m256d cosine(__m256d x) { return sineOfQuadrant(x, 1); }
+
+	BBGRAPH_AVX2_TARGET static __m256d tangent(__m256d x)
+	{
+		__m256i quadrant;
+		const auto r = reduce(x, quadrant);
+		const auto r2 = _mm256_mul_pd(r, r);
+		const auto s = sinePolynomial(r, r2);
+		const auto c = cosinePolynomial(r2);
+
+		return select(isSet(quadrant, 1), _mm256_div_pd(negate(c), s), _mm256_div_pd(s, c));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d exp2(__m256d x)
+	{
+		// Equal to the scalar clamp except for NaN, which is handled at the end
+		const auto clamped = _mm256_min_pd(_mm256_max_pd(x, broadcast(-1022.0)), broadcast(1024.0));
+
+		const auto shifted = _mm256_add_pd(clamped, broadcast(roundingConstant));
+		const auto n = _mm256_sub_pd(shifted, broadcast(roundingConstant));
+
+		const auto p = polynomial(_mm256_mul_pd(_mm256_sub_pd(clamped, n), broadcast(ln2)), expCoefficients);
+
+		const auto m = _mm256_min_pd(n, broadcast(1023.0));
+		const auto mBits = toBits(_mm256_add_pd(m, broadcast(roundingConstant)));
+		const auto scale = fromBits(_mm256_slli_epi64(_mm256_add_epi64(mBits, _mm256_set1_epi64x(1023)), 52));
+		const auto result = _mm256_mul_pd(_mm256_mul_pd(p, scale), _mm256_add_pd(_mm256_sub_pd(n, m), broadcast(1.0)));
+
+		return select(_mm256_cmp_pd(x, x, _CMP_UNORD_Q), x,
+			select(_mm256_cmp_pd(x, broadcast(-1022.0), _CMP_LT_OQ), broadcast(0.0), result));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d exp(__m256d x) { return exp2(_mm256_mul_pd(x, broadcast(log2e))); }
+
+	BBGRAPH_AVX2_TARGET static __m256d log2(__m256d x)
+	{
+		const auto isSubnormal = _mm256_cmp_pd(x, broadcast(std::numeric_limits<double>::min()), _CMP_LT_OQ);
+		const auto bits = toBits(select(isSubnormal, _mm256_mul_pd(x, broadcast(0x1p54)), x));
+
+		const auto exponentBits = _mm256_and_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x7FF));
+		auto e = _mm256_sub_pd(fromBits(_mm256_or_si256(_mm256_set1_epi64x(0x4330000000000000), exponentBits)),
+			broadcast(0x1p52 + 1023.0));
+		e = _mm256_sub_pd(e, select(isSubnormal, broadcast(54.0), broadcast(0.0)));
+
+		auto m = fromBits(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFF)),
+			_mm256_set1_epi64x(0x3FF0000000000000)));
+
+		const auto isLarge = _mm256_cmp_pd(m, broadcast(juce::MathConstants<double>::sqrt2), _CMP_GT_OQ);
+		m = select(isLarge, _mm256_mul_pd(m, broadcast(0.5)), m);
+		e = select(isLarge, _mm256_add_pd(e, broadcast(1.0)), e);
+
+		const auto t = _mm256_div_pd(_mm256_sub_pd(m, broadcast(1.0)), _mm256_add_pd(m, broadcast(1.0)));
+		const auto result = _mm256_add_pd(e, _mm256_mul_pd(t, polynomial(_mm256_mul_pd(t, t), logCoefficients)));
+
+		const auto zero = broadcast(0.0);
+		const auto isFinitePositive = _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_GT_OQ),
+			_mm256_cmp_pd(x, broadcast(infinity), _CMP_LT_OQ));
+
+		return select(isFinitePositive, result,
+			select(_mm256_cmp_pd(x, zero, _CMP_EQ_OQ), broadcast(-infinity),
+				select(_mm256_cmp_pd(x, zero, _CMP_LT_OQ), broadcast(notANumber), x)));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d log(__m256d x) { return _mm256_mul_pd(log2(x), broadcast(ln2)); }
+	BBGRAPH_AVX2_TARGET static __m256d log10(__m256d x) { return _mm256_mul_pd(log2(x), broadcast(log10of2)); }
+
+	BBGRAPH_AVX2_TARGET static __m256d power(__m256d x, __m256d y)
+	{
+		const auto magnitude = exp2(_mm256_mul_pd(y, log2(absolute(x))));
+
+		const auto shifted = _mm256_add_pd(y, broadcast(roundingConstant));
+		const auto isLarge = _mm256_cmp_pd(absolute(y), broadcast(0x1p52), _CMP_GE_OQ);
+		const auto isInteger = _mm256_or_pd(isLarge,
+			_mm256_cmp_pd(_mm256_sub_pd(shifted, broadcast(roundingConstant)), y, _CMP_EQ_OQ));
+		const auto isOdd = _mm256_andnot_pd(isLarge, isSet(toBits(shifted), 1));
+
+		const auto result = select(_mm256_cmp_pd(x, broadcast(0.0), _CMP_LT_OQ),
+			select(isInteger, select(isOdd, negate(magnitude), magnitude), broadcast(notANumber)), magnitude);
+
+		const auto isOne = _mm256_or_pd(_mm256_cmp_pd(y, broadcast(0.0), _CMP_EQ_OQ),
+			_mm256_cmp_pd(x, broadcast(1.0), _CMP_EQ_OQ));
+
+		return select(isOne, broadcast(1.0), result);
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d lookUp(__m256d x, juce::int64 indexOffset)
+	{
+		const auto phase = _mm256_mul_pd(x, broadcast(tableSize / juce::MathConstants<double>::twoPi));
+		const auto shifted = _mm256_add_pd(_mm256_sub_pd(phase, broadcast(0.5)), broadcast(roundingConstant));
+		const auto fraction = _mm256_sub_pd(phase, _mm256_sub_pd(shifted, broadcast(roundingConstant)));
+		const auto index = _mm256_and_si256(_mm256_add_epi64(toBits(shifted), _mm256_set1_epi64x(indexOffset)),
+			_mm256_set1_epi64x(tableSize - 1));
+
+		const auto a = _mm256_i64gather_pd(sineTable.data(), index, sizeof(double));
+		const auto b = _mm256_i64gather_pd(sineTable.data() + 1, index, sizeof(double));
+
+		return _mm256_add_pd(a, _mm256_mul_pd(fraction, _mm256_sub_pd(b, a)));
+	}
+
+	BBGRAPH_AVX2_TARGET static __m256d tableSine(__m256d x) { return lookUp(x, 0); }
+	BBGRAPH_AVX2_TARGET static __m256d tableCosine(__m256d x) { return lookUp(x, tableSize / 4); }
+	BBGRAPH_AVX2_TARGET static __m256d tableTangent(__m256d x) { return _mm256_div_pd(tableSine(x), tableCosine(x)); }
+
+	// Floats are widened to doubles, so they get the results of the double functions rounded to float
+	BBGRAPH_AVX2_TARGET static __m256d load(const double* x) { return _mm256_loadu_pd(x); }
+	BBGRAPH_AVX2_TARGET static __m256d load(const float* x) { return _mm256_cvtps_pd(_mm_loadu_ps(x)); }
+
+	BBGRAPH_AVX2_TARGET static void store(double* result, __m256d x) { _mm256_storeu_pd(result, x); }
+	BBGRAPH_AVX2_TARGET static void store(float* result, __m256d x) { _mm_storeu_ps(result, _mm256_cvtpd_ps(x)); }
+
+	// Process whole groups of 4 samples and return how many samples were done
+	template <__m256d (*function)(__m256d), typename Sample>
+	BBGRAPH_AVX2_TARGET static int unary(const Sample* x, Sample* result, int numSamples)
+	{
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4)
+			store(result + i, function(load(x + i)));
+
+		return i;
+	}
+
+	template <typename Sample>
+	BBGRAPH_AVX2_TARGET static int power(const Sample* x, bool xUniform, const Sample* y, bool yUniform,
+		Sample* result, int numSamples)
+	{
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4)
+		{
+			const auto xValues = xUniform ? broadcast(x[0]) : load(x + i);
+			const auto yValues = yUniform ? broadcast(y[0]) : load(y + i);
+			store(result + i, power(xValues, yValues));
+		}
+
+		return i;
+	}
+};
+
+#pragma endregion
+
+#define BBGRAPH_UNARY_LOOP(function) FastMath::Vector::unary<FastMath::Vector::function, Sample>
+#else
+#define BBGRAPH_UNARY_LOOP(function) nullptr
+#endif
+
+#pragma region Arrays
+
+// Runs the vector loop on as many samples as it takes and the scalar function on the rest
+template <double (*scalar)(double), typename Sample>
+static void applyUnary(int (*vectorLoop)(const Sample*, Sample*, int), const Sample* x, Sample* result, int numSamples)
+{
+	const auto numDone = vectorLoop != nullptr && hasAVX2() ? vectorLoop(x, result, numSamples) : 0;
+
+	for (int i = numDone; i < numSamples; ++i)
+		result[i] = (Sample)scalar(x[i]);
+}
+
+template <typename Sample>
+void FastMath::sine(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<sine, Sample>(BBGRAPH_UNARY_LOOP(sine), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::cosine(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<cosine, Sample>(BBGRAPH_UNARY_LOOP(cosine), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::tangent(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<tangent, Sample>(BBGRAPH_UNARY_LOOP(tangent), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::exp2(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<exp2, Sample>(BBGRAPH_UNARY_LOOP(exp2), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::exp(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<exp, Sample>(BBGRAPH_UNARY_LOOP(exp), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::log2(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<log2, Sample>(BBGRAPH_UNARY_LOOP(log2), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::log(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<log, Sample>(BBGRAPH_UNARY_LOOP(log), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::log10(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<log10, Sample>(BBGRAPH_UNARY_LOOP(log10), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::tableSine(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<tableSine, Sample>(BBGRAPH_UNARY_LOOP(tableSine), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::tableCosine(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<tableCosine, Sample>(BBGRAPH_UNARY_LOOP(tableCosine), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::tableTangent(const Sample* x, Sample* result, int numSamples)
+{
+	applyUnary<tableTangent, Sample>(BBGRAPH_UNARY_LOOP(tableTangent), x, result, numSamples);
+}
+
+template <typename Sample>
+void FastMath::power(const Sample* x, bool xUniform, const Sample* y, bool yUniform, Sample* result, int numSamples)
+{
+	jassert(!(xUniform && yUniform));
+
+	// The loops read a uniform operand at index 0 for every sample. It can share its buffer with the result, so it
+	// points to a copy that the first store doesn't change.
+	const auto xValue = x[0];
+	const auto yValue = y[0];
+
+	if (xUniform) x = &xValue;
+	if (yUniform) y = &yValue;
+
+	int i = 0;
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+		i = Vector::power(x, xUniform, y, yUniform, result, numSamples);
+#endif
+
+	for (; i < numSamples; ++i)
+		result[i] = (Sample)power((double)x[xUniform ? 0 : i], (double)y[yUniform ? 0 : i]);
+}
+
+#define BBGRAPH_ARRAY_FUNCTIONS(Sample) \
+	template void FastMath::sine(const Sample*, Sample*, int); \
+	template void FastMath::cosine(const Sample*, Sample*, int); \
+	template void FastMath::tangent(const Sample*, Sample*, int); \
+	template void FastMath::exp2(const Sample*, Sample*, int); \
+	template void FastMath::exp(const Sample*, Sample*, int); \
+	template void FastMath::log2(const Sample*, Sample*, int); \
+	template void FastMath::log(const Sample*, Sample*, int); \
+	template void FastMath::log10(const Sample*, Sample*, int); \
+	template void FastMath::tableSine(const Sample*, Sample*, int); \
+	template void FastMath::tableCosine(const Sample*, Sample*, int); \
+	template void FastMath::tableTangent(const Sample*, Sample*, int); \
+	template void FastMath::power(const Sample*, bool, const Sample*, bool, Sample*, int);
+
+BBGRAPH_ARRAY_FUNCTIONS(double)
+BBGRAPH_ARRAY_FUNCTIONS(float)
+
+#pragma endregion
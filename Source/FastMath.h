@@ -0,0 +1,230 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Approximations of the transcendental functions for the polynomial and table precision modes of expressions.
+// The scalar versions are inlined into the interpreter, the array versions are for the block processor and
+// process 4 samples per instruction with AVX2 where the cpu supports it. Both do the same operations in the same order.
+// The error bounds were measured against the standard library:
+// - sine, cosine: absolute error below 3e-14 for |x| < 1e8. Larger arguments lose the bits that the range
+//   reduction needs and the error grows like the spacing of doubles around x. Beyond 2^50 the result is meaningless.
+// - tangent: relative error below 1e-13 for |x| < 1e8
+// - exp2, exp: relative error below 1e-13. Results below 2^-1022 are flushed to 0.
+// - log2, log, log10: relative error below 1e-14
+// - power: relative error below 1e-12 while the result is a normal number
+// - tableSine, tableCosine: absolute error below 5e-6, by linear interpolation in a table of one period.
+//   tableTangent is their quotient.
+class FastMath
+{
+public:
+	static double sine(double x) { return sineOfQuadrant(x, 0); }
+
+	// cos x = sin(x + pi / 2), so it is the sine one quadrant further
+	static double cosine(double x) { return sineOfQuadrant(x, 1); }
+
+	static double tangent(double x)
+	{
+		const auto reduced = reduce(x);
+		const auto r2 = reduced.r * reduced.r;
+		const auto s = reduced.r + reduced.r * r2 * polynomial(r2, sineCoefficients);
+		const auto c = 1.0 + r2 * polynomial(r2, cosineCoefficients);
+
+		// tan is periodic with pi, in the odd quadrants it is -cos/sin of the reduced argument
+		return (reduced.quadrant & 1) != 0 ? -c / s : s / c;
+	}
+
+	static double exp2(double x)
+	{
+		// Clamped so that 2^n stays in the range of the exponent, 1024 overflows to infinity
+		const auto clamped = x < -1022.0 ? -1022.0 : (x > 1024.0 ? 1024.0 : x);
+
+		const auto shifted = clamped + roundingConstant;
+		const auto n = shifted - roundingConstant;
+
+		// 2^f = e^(f ln 2) with |f| <= 0.5
+		const auto p = polynomial((clamped - n) * ln2, expCoefficients);
+
+		// 2^1024 has no exponent, so for n = 1024 the scale is 2^1023 and the result is doubled.
+		// The low bits of a number plus roundingConstant hold it as an integer.
+		const auto m = n < 1023.0 ? n : 1023.0;
+		const auto result = p * fromBits((toBits(m + roundingConstant) + 1023) << 52) * (n - m + 1.0);
+
+		return x != x ? x : (x < -1022.0 ? 0.0 : result);
+	}
+
+	static double exp(double x) { return exp2(x * log2e); }
+
+	static double log2(double x)
+	{
+		// Subnormal numbers are scaled into the normal range first
+		const auto isSubnormal = x < std::numeric_limits<double>::min();
+		const auto bits = toBits(isSubnormal ? x * 0x1p54 : x);
+
+		// x = 2^e * m with m in [1, 2). e is converted to a double through the mantissa of 2^52.
+		auto e = fromBits(0x4330000000000000 | ((bits >> 52) & 0x7FF)) - (0x1p52 + 1023.0) - (isSubnormal ? 54.0 : 0.0);
+		auto m = fromBits((bits & 0x000FFFFFFFFFFFFF) | 0x3FF0000000000000);
+
+		// Moving m into [sqrt(1/2), sqrt(2)) keeps t small
+		const auto isLarge = m > juce::MathConstants<double>::sqrt2;
+		m = isLarge ? m * 0.5 : m;
+		e = isLarge ? e + 1.0 : e;
+
+		// ln m = 2 artanh t = 2 (t + t^3 / 3 + t^5 / 5 + ...) with |t| < 0.1716
+		const auto t = (m - 1.0) / (m + 1.0);
+		const auto result = e + t * polynomial(t * t, logCoefficients);
+
+		// log of 0 is -inf, of negative numbers NaN. Infinity and NaN are returned unchanged.
+		return x > 0.0 && x < infinity ? result : (x == 0.0 ? -infinity : (x < 0.0 ? notANumber : x));
+	}
+
+	static double log(double x) { return log2(x) * ln2; }
+
+	static double log10(double x) { return log2(x) * log10of2; }
+
+	static double power(double x, double y)
+	{
+		const auto magnitude = exp2(y * log2(std::abs(x)));
+
+		// Negative bases only have a real power for integer exponents, odd ones keep the sign.
+		// Exponents beyond 2^52 are always integers and are treated as even.
+		const auto shifted = y + roundingConstant;
+		const auto isLarge = std::abs(y) >= 0x1p52;
+		const auto isInteger = isLarge || shifted - roundingConstant == y;
+		const auto isOdd = !isLarge && (toBits(shifted) & 1) != 0;
+
+		const auto result = x < 0.0 ? (isInteger ? (isOdd ? -magnitude : magnitude) : notANumber) : magnitude;
+
+		return y == 0.0 || x == 1.0 ? 1.0 : result;
+	}
+
+	static double tableSine(double x) { return lookUp(x, 0); }
+
+	static double tableCosine(double x) { return lookUp(x, tableSize / 4); }
+
+	static double tableTangent(double x) { return tableSine(x) / tableCosine(x); }
+
+	// The array versions exist for double and float. Floats are evaluated as doubles, so their results are
+	// the ones of the scalar functions rounded to float.
+	template <typename Sample> static void sine(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void cosine(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void tangent(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void exp2(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void exp(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void log2(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void log(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void log10(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void tableSine(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void tableCosine(const Sample* x, Sample* result, int numSamples);
+	template <typename Sample> static void tableTangent(const Sample* x, Sample* result, int numSamples);
+
+	// At most one of the operands may be uniform
+	template <typename Sample>
+	static void power(const Sample* x, bool xUniform, const Sample* y, bool yUniform, Sample* result, int numSamples);
+
+private:
+	struct Vector;
+
+	// Adding and subtracting 1.5 * 2^52 rounds a double to the nearest integer, which then sits in the low bits
+	static constexpr double roundingConstant = 0x1.8p52;
+
+	static constexpr double infinity = std::numeric_limits<double>::infinity();
+	static constexpr double notANumber = std::numeric_limits<double>::quiet_NaN();
+
+	static constexpr double ln2 = 0.69314718055994531;
+	static constexpr double log2e = 1.4426950408889634;
+	static constexpr double log10of2 = 0.30102999566398120;
+
+	// pi / 2 split into parts whose products with integers up to 2^26 are exact
+	static constexpr double halfPi1 = 1.570796325802803;
+	static constexpr double halfPi2 = 9.920935739593517e-10;
+	static constexpr double halfPi3 = 5.721188726109832e-18;
+	static constexpr double twoOverPi = 0.6366197723675814;
+
+	// The Taylor series, highest power first. On [-pi / 4, pi / 4] the first omitted terms of sine and cosine are
+	// below 2e-14 and 1e-15, on [-ln 2 / 2, ln 2 / 2] the one of exp is below 2e-16.
+	static constexpr double sineCoefficients[] =
+		{ 1.0 / 6227020800.0, -1.0 / 39916800.0, 1.0 / 362880.0, -1.0 / 5040.0, 1.0 / 120.0, -1.0 / 6.0 };
+	static constexpr double cosineCoefficients[] =
+		{ -1.0 / 87178291200.0, 1.0 / 479001600.0, -1.0 / 3628800.0, 1.0 / 40320.0, -1.0 / 720.0, 1.0 / 24.0, -0.5 };
+	static constexpr double expCoefficients[] =
+		{ 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+		  1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0 };
+
+	// 2 artanh t / t as a series in t^2, scaled to log2
+	static constexpr double logCoefficients[] =
+		{ 2.0 * log2e / 17.0, 2.0 * log2e / 15.0, 2.0 * log2e / 13.0, 2.0 * log2e / 11.0, 2.0 * log2e / 9.0,
+		  2.0 * log2e / 7.0, 2.0 * log2e / 5.0, 2.0 * log2e / 3.0, 2.0 * log2e };
+
+	static constexpr int tableSize = 1024;
+
+	// One period of the sine with a copy of the first entry at the end, so interpolation never has to wrap
+	static const std::array<double, tableSize + 1> sineTable;
+
+	static juce::uint64 toBits(double x)
+	{
+		juce::uint64 bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		return bits;
+	}
+
+	static double fromBits(juce::uint64 bits)
+	{
+		double x;
+		std::memcpy(&x, &bits, sizeof(x));
+		return x;
+	}
+
+	template <size_t numCoefficients>
+	static double polynomial(double x, const double (&coefficients)[numCoefficients])
+	{
+		auto result = coefficients[0];
+
+		for (size_t i = 1; i < numCoefficients; ++i)
+			result = coefficients[i] + x * result;
+
+		return result;
+	}
+
+	struct Reduced
+	{
+		// x - quadrant * pi / 2, in [-pi / 4, pi / 4]
+		double r;
+		juce::uint64 quadrant;
+	};
+
+	static Reduced reduce(double x)
+	{
+		const auto shifted = x * twoOverPi + roundingConstant;
+		const auto q = shifted - roundingConstant;
+
+		return { ((x - q * halfPi1) - q * halfPi2) - q * halfPi3, toBits(shifted) };
+	}
+
+	static double sineOfQuadrant(double x, juce::uint64 quadrantOffset)
+	{
+		const auto reduced = reduce(x);
+		const auto quadrant = reduced.quadrant + quadrantOffset;
+		const auto r2 = reduced.r * reduced.r;
+
+		// sin(r + q pi / 2) cycles through sin r, cos r, -sin r, -cos r
+		const auto value = (quadrant & 1) != 0
+			? 1.0 + r2 * polynomial(r2, cosineCoefficients)
+			: reduced.r + reduced.r * r2 * polynomial(r2, sineCoefficients);
+
+		return fromBits(toBits(value) ^ ((quadrant & 2) << 62));
+	}
+
+	static double lookUp(double x, int indexOffset)
+	{
+		// The index is rounded down by rounding phase - 0.5. If that rounds an exact index down to the one below,
+		// the fraction becomes 1, which still interpolates to the right entry.
+		const auto phase = x * (tableSize / juce::MathConstants<double>::twoPi);
+		const auto shifted = (phase - 0.5) + roundingConstant;
+		const auto fraction = phase - (shifted - roundingConstant);
+		const auto index = (toBits(shifted) + (juce::uint64)indexOffset) & (tableSize - 1);
+
+		const auto a = sineTable[index];
+		const auto b = sineTable[index + 1];
+		return a + fraction * (b - a);
+	}
+};
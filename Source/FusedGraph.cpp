@@ -0,0 +1,344 @@
+#include "FusedGraph.h"
+
+#include "ByteCodeOptimiser.h"
+
+std::unique_ptr<FusedGraph> FusedGraph::compile(const juce::Array<Node*>& allNodes)
+{
+	std::unique_ptr<FusedGraph> graph(new FusedGraph);
+
+	const auto orderedNodes = graph->findLiveNodes(allNodes);
+
+	const auto stereo = std::any_of(orderedNodes.begin(), orderedNodes.end(), [](Node* node)
+		{
+			const auto output = dynamic_cast<InternalNodeGraph::OutputNode*>(node);
+			return output != nullptr && output->isStereo();
+		});
+
+	graph->findSharedNodes(orderedNodes);
+
+	for (const auto node : orderedNodes)
+	{
+		// Merged nodes are never written, so they don't read their inputs
+		if (graph->getRepresentative(node) != node) continue;
+
+		graph->nodeUses[node].isShared = graph->isVoiceInvariant(node);
+
+		// With a stereo output, mono outputs are written into the programs of both channels
+		const auto output = dynamic_cast<InternalNodeGraph::OutputNode*>(node);
+		const auto count = output != nullptr && stereo && !output->isStereo() ? 2 : 1;
+
+		for (const auto& c : node->inputs)
+		{
+			auto& use = graph->nodeUses[graph->getRepresentative(c.otherNode)];
+			use.count += count;
+			use.reader = node;
+		}
+	}
+
+	std::vector<Op> leftCode, rightCode;
+	std::vector<double> leftConstants, rightConstants;
+
+	for (const auto node : orderedNodes)
+	{
+		if (graph->getRepresentative(node) != node) continue;
+
+		if (const auto outputNode = dynamic_cast<InternalNodeGraph::OutputNode*>(node))
+		{
+			if (outputNode->isStereo())
+			{
+				graph->writeOutput(node, 0, leftCode, leftConstants);
+				graph->writeOutput(node, 1, rightCode, rightConstants);
+			}
+			else
+			{
+				graph->writeOutput(node, -1, leftCode, leftConstants);
+				if (stereo) graph->writeOutput(node, -1, rightCode, rightConstants);
+			}
+		}
+		else if (const auto exprNode = dynamic_cast<InternalNodeGraph::ExpressionNode*>(node))
+		{
+			if (graph->isInlined(node)) continue;
+
+			std::vector<Op> byteCode;
+			std::vector<double> numberConstants;
+			graph->writeExpression(node, byteCode, numberConstants);
+
+			const auto value = graph->addProgram(byteCode, numberConstants, exprNode->processor->mathOptions);
+			graph->values[(size_t)value].controlInterval = getControlInterval(node);
+			graph->values[(size_t)value].interpolate = isInterpolated(node);
+			graph->nodeUses[node].value = value;
+		}
+		else if (dynamic_cast<InternalNodeGraph::ParameterNode*>(node) != nullptr)
+		{
+			graph->nodeUses[node].value = (int)graph->values.size();
+			graph->values.push_back({ nullptr, node->properties["parameterID"].toString(), ByteCodeProcessor::Rate::block, true });
+		}
+		else jassertfalse;
+	}
+
+	if (!leftCode.empty())
+	{
+		graph->left = graph->addProgram(leftCode, leftConstants, {});
+		graph->right = stereo ? graph->addProgram(rightCode, rightConstants, {}) : graph->left;
+	}
+
+	graph->nodeUses.clear();
+	graph->representatives.clear();
+
+	return graph;
+}
+
+juce::Array<InternalNodeGraph::Node*> FusedGraph::findLiveNodes(const juce::Array<Node*>& orderedNodes)
+{
+	std::unordered_set<Node*> liveNodes;
+
+	// Readers come after the nodes they read, so going backwards reaches every reader before its inputs
+	for (int i = orderedNodes.size(); --i >= 0;)
+	{
+		const auto node = orderedNodes.getUnchecked(i);
+
+		if (dynamic_cast<InternalNodeGraph::OutputNode*>(node) == nullptr && liveNodes.count(node) == 0)
+		{
+			excludedNodes.insert(node->nodeID);
+			continue;
+		}
+
+		liveNodes.insert(node);
+
+		for (const auto& c : node->inputs)
+			liveNodes.insert(c.otherNode);
+	}
+
+	juce::Array<Node*> result;
+
+	for (const auto node : orderedNodes)
+		if (liveNodes.count(node) != 0)
+			result.add(node);
+
+	return result;
+}
+
+void FusedGraph::findSharedNodes(const juce::Array<Node*>& orderedNodes)
+{
+	std::map<std::vector<juce::uint64>, Node*> expressions;
+	std::map<juce::String, Node*> parameters;
+
+	for (int i = 0; i < orderedNodes.size(); ++i)
+	{
+		const auto node = orderedNodes.getUnchecked(i);
+		auto representative = node;
+
+		if (const auto exprNode = dynamic_cast<InternalNodeGraph::ExpressionNode*>(node))
+		{
+			const auto& processor = *exprNode->processor;
+
+			if (std::find(processor.byteCode.begin(), processor.byteCode.end(), Op::random) == processor.byteCode.end())
+			{
+				// The nodes at the inputs are written as nodeValue ops with the position of their representative
+				std::vector<Op> byteCode;
+				std::vector<double> numberConstants;
+				writeExpression(node, byteCode, numberConstants);
+				ByteCodeOptimiser::normalise(byteCode, numberConstants);
+
+				std::vector<juce::uint64> key{ (juce::uint64)processor.mathOptions.precision, (juce::uint64)processor.mathOptions.exactComparisons,
+					(juce::uint64)getControlInterval(node), (juce::uint64)isInterpolated(node) };
+				auto nextNum = numberConstants.begin();
+
+				for (const auto op : byteCode)
+				{
+					key.push_back((juce::uint64)op);
+
+					if (op == Op::numberConstant || op == Op::nodeValue)
+					{
+						juce::uint64 bits;
+						std::memcpy(&bits, &*nextNum++, sizeof(bits));
+						key.push_back(bits);
+					}
+				}
+
+				representative = expressions.emplace(std::move(key), node).first->second;
+			}
+		}
+		else if (dynamic_cast<InternalNodeGraph::ParameterNode*>(node) != nullptr)
+		{
+			representative = parameters.emplace(node->properties["parameterID"].toString(), node).first->second;
+		}
+
+		representatives[node] = representative;
+
+		if (representative != node)
+			sharedNodes[node->nodeID] = representative->nodeID;
+		else
+			nodeUses[node].value = i;
+	}
+
+	// The positions were only needed for the keys
+	nodeUses.clear();
+}
+
+InternalNodeGraph::Node* FusedGraph::getRepresentative(Node* node) const
+{
+	const auto representative = representatives.find(node);
+	return representative != representatives.end() ? representative->second : node;
+}
+
+bool FusedGraph::isInlined(Node* node) const
+{
+	// A node at control rate has to keep its own value
+	if (dynamic_cast<InternalNodeGraph::ExpressionNode*>(node) == nullptr || getControlInterval(node) != 0) return false;
+
+	const auto use = nodeUses.find(node);
+
+	if (use == nodeUses.end() || use->second.count != 1 || getMathOptions(node) != getMathOptions(use->second.reader)) return false;
+
+	// A shared value inlined into a voice value would be computed by every voice
+	const auto reader = nodeUses.find(use->second.reader);
+	return reader != nodeUses.end() && reader->second.isShared == use->second.isShared;
+}
+
+bool FusedGraph::isVoiceInvariant(Node* node) const
+{
+	if (const auto exprNode = dynamic_cast<InternalNodeGraph::ExpressionNode*>(node))
+	{
+		const auto& byteCode = exprNode->processor->byteCode;
+
+		if (std::any_of(byteCode.begin(), byteCode.end(), readsVoice)) return false;
+	}
+
+	for (const auto& c : node->inputs)
+	{
+		const auto use = nodeUses.find(getRepresentative(c.otherNode));
+
+		if (use == nodeUses.end() || !use->second.isShared) return false;
+	}
+
+	return true;
+}
+
+bool FusedGraph::readsVoice(Op op)
+{
+	// Everything else is the same in every voice: the free running and host time, the sample rate, the tempo and the parameters
+	return op == Op::t || op == Op::n || op == Op::r || op == Op::rs || op == Op::nf || op == Op::random;
+}
+
+void FusedGraph::writeExpression(Node* node, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const
+{
+	const auto& processor = *static_cast<InternalNodeGraph::ExpressionNode*>(node)->processor;
+
+	// An expression that never was valid evaluates to 0
+	if (processor.byteCode.empty())
+	{
+		byteCode.push_back(Op::numberConstant);
+		numberConstants.push_back(0.0);
+		return;
+	}
+
+	auto nextNum = processor.numberConstants.begin();
+
+	for (const auto op : processor.byteCode)
+	{
+		if (op >= Op::a && op <= Op::d)
+		{
+			writeInputSum(node, op - Op::a, byteCode, numberConstants);
+			continue;
+		}
+
+		byteCode.push_back(op);
+
+		if (op == Op::numberConstant)
+			numberConstants.push_back(*nextNum++);
+	}
+}
+
+void FusedGraph::writeInputSum(Node* node, int channel, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const
+{
+	// The sum starts from +0 like the inputs of a node always did, so a -0 at an input arrives as +0.
+	// The optimiser only removes the +0 if the sum is an integer.
+	byteCode.push_back(Op::numberConstant);
+	numberConstants.push_back(0.0);
+
+	for (const auto& c : node->inputs)
+	{
+		if (channel >= 0 && c.thisChannel != channel) continue;
+
+		writeNodeValue(c.otherNode, byteCode, numberConstants);
+		byteCode.push_back(Op::add);
+	}
+}
+
+void FusedGraph::writeNodeValue(Node* node, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const
+{
+	node = getRepresentative(node);
+
+	if (isInlined(node))
+	{
+		writeExpression(node, byteCode, numberConstants);
+		byteCode.push_back(Op::finite);
+		return;
+	}
+
+	const auto use = nodeUses.find(node);
+	const auto value = use != nodeUses.end() ? use->second.value : -1;
+
+	byteCode.push_back(value >= 0 ? Op::nodeValue : Op::numberConstant);
+	numberConstants.push_back(value >= 0 ? (double)value : 0.0);
+}
+
+void FusedGraph::writeOutput(Node* node, int channel, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const
+{
+	const auto isFirst = byteCode.empty();
+
+	// The sum is cast to an unsigned byte, which keeps the lowest 8 bits of its integer part, and scaled to [-1, 1)
+	writeInputSum(node, channel, byteCode, numberConstants);
+	byteCode.insert(byteCode.end(), { Op::numberConstant, Op::bitand, Op::numberConstant, Op::divide, Op::numberConstant, Op::subtract });
+	numberConstants.insert(numberConstants.end(), { 255.0, 128.0, 1.0 });
+
+	if (!isFirst) byteCode.push_back(Op::add);
+}
+
+int FusedGraph::addProgram(std::vector<Op>& byteCode, std::vector<double>& numberConstants, const ByteCodeProcessor::MathOptions& options)
+{
+	auto processor = std::make_unique<ByteCodeProcessor>();
+	processor->mathOptions = options;
+
+	for (const auto& value : values)
+		processor->valueRates.push_back(value.rate);
+
+	auto isShared = true;
+	auto nextNum = numberConstants.begin();
+
+	for (const auto op : byteCode)
+	{
+		if (readsVoice(op) || (op == Op::nodeValue && !values[(size_t)*nextNum].isShared))
+			isShared = false;
+
+		if (op == Op::numberConstant || op == Op::nodeValue)
+			++nextNum;
+	}
+
+	processor->setByteCode(byteCode, numberConstants);
+
+	const auto rate = processor->getRate();
+	values.push_back({ std::move(processor), {}, rate, isShared });
+
+	return (int)values.size() - 1;
+}
+
+ByteCodeProcessor::MathOptions FusedGraph::getMathOptions(Node* node)
+{
+	if (const auto exprNode = dynamic_cast<InternalNodeGraph::ExpressionNode*>(node))
+		return exprNode->processor->mathOptions;
+
+	// The output programs only use ops that don't depend on the options
+	return {};
+}
+
+int FusedGraph::getControlInterval(Node* node)
+{
+	return node->properties.getWithDefault("controlInterval", 0);
+}
+
+bool FusedGraph::isInterpolated(Node* node)
+{
+	return node->properties.getWithDefault("interpolate", false);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "ByteCodeProcessor.h"
+#include "InternalNodeGraph.h"
+
+// The expressions of a graph compiled into as few programs as possible. The byte code of an expression node is
+// inlined into the expression that reads it, with the values at each input summed up by add ops, so chains and
+// trees of nodes become one program. A node keeps a program of its own if its value is read more than once or
+// with other math options, the programs that read it load the value with nodeValue ops.
+// Every output channel gets a program that sums and converts the values of the output nodes.
+// Nodes that don't feed into an output are left out.
+// Values that don't depend on t, n, r, rs, nf, rand or other values that do are the same in every voice. They are
+// shared, computed once for all voices, and never inlined into a program that isn't, so the voices only compute the rest.
+// Nodes at control rate keep a program of their own, which is only evaluated every few samples.
+// Expression nodes that compute the same value as an earlier node are merged into it first: nodes with the same
+// math options, the same byte code up to the order of commutative operands and the same nodes at their inputs.
+// Expressions with rand ops are never merged, each of them draws its own numbers.
+class FusedGraph
+{
+public:
+	struct Value
+	{
+		// The program that computes the value, nullptr for parameters. It is compiled from a copy of the byte code of
+		// the nodes and never changes, so editing a node doesn't touch what the voices run.
+		std::unique_ptr<const ByteCodeProcessor> processor;
+
+		// The parameter the value is read from
+		juce::String parameterID;
+
+		// How often the value changes. Values below the sample rate only have to be computed at the start of a note or block.
+		ByteCodeProcessor::Rate rate;
+
+		// The value is the same in every voice
+		bool isShared;
+
+		// Samples between the evaluations of a value that changes every sample, 0 for every sample and -1 for once
+		// per block. In between the value is held, or ramps from the last value to the new one.
+		int controlInterval = 0;
+		bool interpolate = false;
+	};
+
+	// Every node has to come after the nodes at its inputs
+	static std::unique_ptr<FusedGraph> compile(const juce::Array<InternalNodeGraph::Node*>& orderedNodes);
+
+	// In the order they have to be computed in. Programs only read the values before them.
+	std::vector<Value> values;
+
+	// The values of the output channels, -1 without output nodes. Both are the same value if no output is stereo.
+	int left = -1;
+	int right = -1;
+
+	// Nodes that were merged into an earlier node, mapped to that node. Only the earlier node is evaluated.
+	std::map<InternalNodeGraph::NodeID, InternalNodeGraph::NodeID> sharedNodes;
+
+	// Nodes that were left out, because their values never reach an output
+	std::set<InternalNodeGraph::NodeID> excludedNodes;
+
+private:
+	using Node = InternalNodeGraph::Node;
+	using Op = ByteCodeProcessor::Op;
+
+	struct NodeUse
+	{
+		// How often the value of the node is read, and by which node
+		int count = 0;
+		Node* reader = nullptr;
+
+		// The index of the value of the node, -1 if it is inlined
+		int value = -1;
+
+		bool isShared = false;
+	};
+
+	FusedGraph() = default;
+
+	// Returns the nodes that feed into an output, in the same order, and fills excludedNodes with the others
+	juce::Array<Node*> findLiveNodes(const juce::Array<Node*>& orderedNodes);
+
+	// Fills representatives and sharedNodes
+	void findSharedNodes(const juce::Array<Node*>& orderedNodes);
+
+	Node* getRepresentative(Node* node) const;
+
+	bool isInlined(Node* node) const;
+
+	// Whether the value of a node is the same in every voice. The nodes at its inputs have to be known already.
+	bool isVoiceInvariant(Node* node) const;
+
+	// Ops that read values of the voice
+	static bool readsVoice(Op op);
+
+	// Writes the byte code of an expression node, with the inputs replaced by their sums
+	void writeExpression(Node* node, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const;
+
+	// Sums the values at an input of a node. A channel of -1 sums all inputs.
+	void writeInputSum(Node* node, int channel, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const;
+
+	void writeNodeValue(Node* node, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const;
+
+	// Adds the value of an output node to the program of a channel
+	void writeOutput(Node* node, int channel, std::vector<Op>& byteCode, std::vector<double>& numberConstants) const;
+
+	// Compiles the byte code and returns the index of its value
+	int addProgram(std::vector<Op>& byteCode, std::vector<double>& numberConstants, const ByteCodeProcessor::MathOptions& options);
+
+	static ByteCodeProcessor::MathOptions getMathOptions(Node* node);
+
+	static int getControlInterval(Node* node);
+	static bool isInterpolated(Node* node);
+
+	// Only valid while compiling
+	std::unordered_map<Node*, NodeUse> nodeUses;
+	std::unordered_map<Node*, Node*> representatives;
+};
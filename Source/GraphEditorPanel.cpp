@@ -166,7 +166,15 @@ struct GraphEditorPanel::NodeComponent : Component, private juce::AsyncUpdater
 		const auto p = panel.getNodePosition(nodeID);
 		setCentreRelative(static_cast<float>(p.x), static_cast<float>(p.y));
 
+		// Nodes that don't reach an output aren't evaluated
+		setAlpha(f->properties.contains("excluded") ? 0.5f : 1.0f);
+
 		resized();
+		onUpdate();
+	}
+
+	virtual void onUpdate()
+	{
 	}
 
 	virtual void showPopupMenu() = 0;
@@ -386,6 +394,7 @@ struct GraphEditorPanel::ExpressionNodeComponent : NodeComponent
 		auto* node = graph.getNodeForId(nodeID);
 		textBox.setText(node->properties.getWithDefault("expression", ""));
 		updateOutlineColor(node);
+		updateTooltip(node);
 
 		textBox.onReturnKey = [this]()
 		{
@@ -400,8 +409,9 @@ struct GraphEditorPanel::ExpressionNodeComponent : NodeComponent
 			if (node->properties.getWithDefault("expression", "").equals(expressionString)) return;
 
 			node->properties.set("expression", expressionString);
-			node->update();
+			graph.nodeChanged(nodeID);
 			updateOutlineColor(node);
+			updateTooltip(node);
 		};
 
 		textBox.onTextChange = [this]()
@@ -421,21 +431,58 @@ struct GraphEditorPanel::ExpressionNodeComponent : NodeComponent
 
 	void showPopupMenu() override
 	{
+		const auto* node = graph.getNodeForId(nodeID);
+		const int precision = node->properties.getWithDefault("precision", 0);
+		const bool exactComparisons = node->properties.getWithDefault("exactComparisons", false);
+		const int controlInterval = node->properties.getWithDefault("controlInterval", 0);
+		const bool interpolate = node->properties.getWithDefault("interpolate", false);
+
+		// Slow modulation doesn't have to be evaluated every sample
+		juce::PopupMenu rateMenu;
+		rateMenu.addItem(7, "Every sample", true, controlInterval == 0);
+		rateMenu.addItem(8, "Every 16 samples", true, controlInterval == 16);
+		rateMenu.addItem(9, "Every 64 samples", true, controlInterval == 64);
+		rateMenu.addItem(10, "Once per block", true, controlInterval < 0);
+		rateMenu.addSeparator();
+		rateMenu.addItem(11, "Interpolate", controlInterval != 0, interpolate);
+
+		juce::PopupMenu precisionMenu;
+		precisionMenu.addItem(3, "Exact", true, precision == 0);
+		precisionMenu.addItem(4, "Polynomial approximations", true, precision == 1);
+		precisionMenu.addItem(5, "Table approximations", true, precision == 2);
+
 		menu.reset(new juce::PopupMenu);
 		menu->addItem(1, "Delete");
 		menu->addItem(2, "Disconnect all pins");
+		menu->addSubMenu("Rate", rateMenu);
+		menu->addSeparator();
+		menu->addSubMenu("Precision", precisionMenu);
+		menu->addItem(6, "Exact comparisons", true, exactComparisons);
 
 		menu->showMenuAsync({}, juce::ModalCallbackFunction::create
-		([this](int r) {
+		([this, exactComparisons, interpolate](int r) {
 				switch (r)
 				{
 				case 1:   graph.removeNode(nodeID); break;
 				case 2:   graph.disconnectNode(nodeID); break;
-
+				case 3:
+				case 4:
+				case 5:   setNodeProperty("precision", r - 3); break;
+				case 6:   setNodeProperty("exactComparisons", !exactComparisons); break;
+				case 7:   setNodeProperty("controlInterval", 0); break;
+				case 8:   setNodeProperty("controlInterval", 16); break;
+				case 9:   setNodeProperty("controlInterval", 64); break;
+				case 10:  setNodeProperty("controlInterval", -1); break;
+				case 11:  setNodeProperty("interpolate", !interpolate); break;
 				}
 			}));
 	}
 
+	void onUpdate() override
+	{
+		updateTooltip(graph.getNodeForId(nodeID));
+	}
+
 	void onResize() override
 	{
 		auto bounds = getLocalBounds();
@@ -446,6 +493,13 @@ struct GraphEditorPanel::ExpressionNodeComponent : NodeComponent
 	}
 
 private:
+	void setNodeProperty(const juce::Identifier& name, const juce::var& value)
+	{
+		auto* node = graph.getNodeForId(nodeID);
+		node->properties.set(name, value);
+		graph.nodeChanged(nodeID);
+	}
+
 	void updateOutlineColor(InternalNodeGraph::Node* node)
 	{
 		if (node->properties.getWithDefault("validExpression", true))
@@ -460,6 +514,25 @@ private:
 		}
 	}
 
+	void updateTooltip(InternalNodeGraph::Node* node)
+	{
+		auto* expressionNode = dynamic_cast<InternalNodeGraph::ExpressionNode*>(node);
+		auto numRemovedOps = expressionNode != nullptr ? expressionNode->processor->getNumRemovedOps() : 0;
+
+		juce::StringArray lines;
+
+		if (numRemovedOps > 0)
+			lines.add("Optimiser removed " + juce::String(numRemovedOps) + " ops");
+
+		if (node->properties.contains("sharedWith"))
+			lines.add("Computes the same value as another node, which is evaluated once for both");
+
+		if (node->properties.contains("excluded"))
+			lines.add("Not evaluated, because it isn't connected to an output");
+
+		textBox.setTooltip(lines.joinIntoString("\n"));
+	}
+
 	void updateWidth()
 	{
 		auto textWidth = font.getStringWidthFloat(textBox.getText());
@@ -850,6 +923,15 @@ void GraphEditorPanel::showPopupMenu(juce::Point<int> position)
 	menu->addItem(NodeType::Output, "Output Node");
 	menu->addItem(NodeType::Parameter, "Parameter Node");
 	menu->addSeparator();
+	menu->addItem(5, "Single precision", true, graph.isSinglePrecision());
+
+	juce::PopupMenu renderRateMenu;
+	renderRateMenu.addItem(6, "Host rate", true, graph.getRenderRate() == 0);
+
+	for (int i = 0; i < juce::numElementsInArray(renderRates); ++i)
+		renderRateMenu.addItem(7 + i, juce::String(renderRates[i]) + " Hz", true, graph.getRenderRate() == renderRates[i]);
+
+	menu->addSubMenu("Render rate", renderRateMenu);
 	menu->addItem(4, "Clear graph");
 
 
@@ -860,6 +942,12 @@ void GraphEditorPanel::showPopupMenu(juce::Point<int> position)
 					createNewNode(NodeType(r), position);
 				else if (r == 4)
 					graph.clear();
+				else if (r == 5)
+					graph.setSinglePrecision(!graph.isSinglePrecision());
+				else if (r == 6)
+					graph.setRenderRate(0);
+				else if (r >= 7 && r < 7 + juce::numElementsInArray(renderRates))
+					graph.setRenderRate(renderRates[r - 7]);
 
 			}));
 }
@@ -63,6 +63,9 @@ public:
 private:
 
 	juce::AudioProcessorValueTreeState& apvts;
+
+	// The rates the graph can render at besides the host rate
+	static constexpr int renderRates[] = { 8000, 11025, 22050 };
 	
 	NodeComponent* getComponentForNode(InternalNodeGraph::NodeID) const;
 	ConnectorComponent* getComponentForConnection(const InternalNodeGraph::Connection&) const;
@@ -72,4 +75,5 @@ private:
 	juce::OwnedArray<ConnectorComponent> connectors;
 	std::unique_ptr<ConnectorComponent> draggingConnector;
 	std::unique_ptr<juce::PopupMenu> menu;
+	juce::TooltipWindow tooltipWindow{ this };
 };
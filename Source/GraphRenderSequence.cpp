@@ -3,74 +3,47 @@
 #include "InternalNodeGraph.h"
 #include "NodeProcessor.h"
 
-GraphRenderSequence::GraphRenderSequence(InternalNodeGraph& g) : graph(g), orderedNodes(createOrderedNodeList(graph)), numNodes(orderedNodes.size())
+GraphRenderSequence::GraphRenderSequence(InternalNodeGraph& g) : graph(g), fusedGraph(FusedGraph::compile(createOrderedNodeList(graph))),
+	singlePrecision(graph.isSinglePrecision()), renderRate(graph.getRenderRate())
 {
-	for (int i = 0; i < numNodes; ++i)
-	{
-		nodeIDtoIndex.insert({ orderedNodes[i]->nodeID.uid, i });
-	}
 }
 
-NodeProcessorSequence* GraphRenderSequence::createNodeProcessorSequence(juce::AudioProcessorValueTreeState& apvts)
+NodeProcessorSequence* GraphRenderSequence::createSharedSequence(juce::AudioProcessorValueTreeState& apvts)
 {
-	const auto sequence = new NodeProcessorSequence();
+	if (singlePrecision)
+		return createTypedSequence<float>(apvts, nullptr);
 
-	for (const auto node : orderedNodes)
-	{
-		if (const auto exprNode = dynamic_cast<InternalNodeGraph::ExpressionNode*>(node))
-		{
-			const auto processor = new ExpressionNodeProcessor(*exprNode->processor, sequence->globalValues);
-			processor->inputs.resize(expr_node_num_ins);
-			for (const auto c : node->inputs)
-			{
-				processor->inputs[c.thisChannel].push_back(sequence->processors[nodeIDtoIndex[c.otherNode->nodeID.uid]]);
-			}
+	return createTypedSequence<double>(apvts, nullptr);
+}
 
-			sequence->processors.add(processor);
-		}
-		else if (const auto outputNode = dynamic_cast<InternalNodeGraph::OutputNode*>(node))
-		{
-			if (outputNode->isStereo())
-			{
-				const auto processorL = new OutputNodeProcessor(left);
-				const auto processorR = new OutputNodeProcessor(right);
-				processorL->inputs.resize(1);
-				processorR->inputs.resize(1);
-
-				for (const auto c : node->inputs)
-				{
-					if (c.thisChannel == 0)
-					{
-						processorL->inputs[0].push_back(sequence->processors[nodeIDtoIndex[c.otherNode->nodeID.uid]]);
-					}
-					else
-					{
-						processorR->inputs[0].push_back(sequence->processors[nodeIDtoIndex[c.otherNode->nodeID.uid]]);
-					}
-				}
-				sequence->processors.add(processorL);
-				sequence->processors.add(processorR);
-			}
-			else
-			{
-				const auto processor = new OutputNodeProcessor(mono);
-				processor->inputs.resize(1);
-
-				for (const auto c : node->inputs)
-				{
-					processor->inputs[0].push_back(sequence->processors[nodeIDtoIndex[c.otherNode->nodeID.uid]]);
-				}
-				sequence->processors.add(processor);
-			}
-		}
-		else if (const auto paramNode = dynamic_cast<InternalNodeGraph::ParameterNode*>(node))
-		{
-			sequence->processors.add(new ParameterNodeProcessor(*dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(paramNode->properties["parameterID"].toString()))));
-		}
-		else jassertfalse;
+NodeProcessorSequence* GraphRenderSequence::createNodeProcessorSequence(juce::AudioProcessorValueTreeState& apvts,
+	const NodeProcessorSequence& sharedSequence)
+{
+	if (singlePrecision)
+		return createTypedSequence<float>(apvts, &sharedSequence);
+
+	return createTypedSequence<double>(apvts, &sharedSequence);
+}
+
+template <typename Sample>
+TypedNodeProcessorSequence<Sample>* GraphRenderSequence::createTypedSequence(juce::AudioProcessorValueTreeState& apvts,
+	const NodeProcessorSequence* sharedSequence)
+{
+	// The voices run the plan of the shared sequence, it is only built once
+	if (sharedSequence != nullptr)
+		return new TypedNodeProcessorSequence<Sample>(dynamic_cast<const TypedNodeProcessorSequence<Sample>*>(sharedSequence));
+
+	auto plan = std::make_unique<typename TypedNodeProcessorSequence<Sample>::Plan>(fusedGraph->left, fusedGraph->right);
+
+	for (const auto& value : fusedGraph->values)
+	{
+		if (value.processor != nullptr)
+			plan->addProgram(*value.processor, value.isShared, value.controlInterval, value.interpolate);
+		else
+			plan->addParameter(*dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(value.parameterID)));
 	}
 
-	return sequence;
+	return new TypedNodeProcessorSequence<Sample>(std::move(plan));
 }
 
 void GraphRenderSequence::getAllParentsOfNode(
@@ -2,18 +2,32 @@
 
 #include <JuceHeader.h>
 
+#include "FusedGraph.h"
 #include "InternalNodeGraph.h"
 
 class NodeProcessorSequence;
+template <typename Sample> class TypedNodeProcessorSequence;
 
 struct  GraphRenderSequence
 {
 public:
 	GraphRenderSequence(InternalNodeGraph& g);
 
-	NodeProcessorSequence* createNodeProcessorSequence(juce::AudioProcessorValueTreeState& apvts);
+	// Evaluates with floats or doubles, as the graph was set to when this was created.
+	// The shared sequence computes the values that are the same in every voice, it has to be created first.
+	NodeProcessorSequence* createSharedSequence(juce::AudioProcessorValueTreeState& apvts);
+	NodeProcessorSequence* createNodeProcessorSequence(juce::AudioProcessorValueTreeState& apvts, const NodeProcessorSequence& sharedSequence);
+
+	const FusedGraph& getFusedGraph() const { return *fusedGraph; }
+
+	// The rate the graph was set to render at, 0 for the host rate
+	double getRenderRate() const noexcept { return renderRate; }
 
 private:
+	template <typename Sample>
+	TypedNodeProcessorSequence<Sample>* createTypedSequence(juce::AudioProcessorValueTreeState& apvts,
+		const NodeProcessorSequence* sharedSequence);
+
 	static void getAllParentsOfNode(
 		const InternalNodeGraph::Node* child,
 		std::unordered_set<InternalNodeGraph::Node*>& parents,
@@ -21,9 +35,8 @@ private:
 
 	static juce::Array<InternalNodeGraph::Node*> createOrderedNodeList(const InternalNodeGraph& graph);
 
-	std::unordered_map<juce::uint32, int> nodeIDtoIndex;
-
 	InternalNodeGraph& graph;
-	const juce::Array<InternalNodeGraph::Node*> orderedNodes;
-	const int numNodes;
+	const std::unique_ptr<const FusedGraph> fusedGraph;
+	const bool singlePrecision;
+	const double renderRate;
 };
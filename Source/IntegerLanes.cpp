@@ -0,0 +1,407 @@
+#include "IntegerLanes.h"
+
+#include "Defines.h"
+
+#pragma region Operations
+
+// Each operation has a scalar version and, on intel, an AVX2 version. Shift counts are masked to 5 bits like the
+// x86 shift instructions do, so both versions give the same results as the casts in the double path.
+
+struct BitAnd
+{
+	static int scalar(int x, int y) { return x & y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+#endif
+};
+
+struct BitOr
+{
+	static int scalar(int x, int y) { return x | y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+#endif
+};
+
+struct BitXor
+{
+	static int scalar(int x, int y) { return x ^ y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+#endif
+};
+
+struct LeftShift
+{
+	static int scalar(int x, int y) { return (int)((juce::uint32)x << (y & 31)); }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_sllv_epi32(x, _mm256_and_si256(y, _mm256_set1_epi32(31))); }
+#endif
+};
+
+struct RightShift
+{
+	static int scalar(int x, int y) { return x >> (y & 31); }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_srav_epi32(x, _mm256_and_si256(y, _mm256_set1_epi32(31))); }
+#endif
+};
+
+struct LogicalAnd
+{
+	static int scalar(int x, int y) { return x && y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y)
+	{
+		const auto zero = _mm256_setzero_si256();
+		const auto eitherZero = _mm256_or_si256(_mm256_cmpeq_epi32(x, zero), _mm256_cmpeq_epi32(y, zero));
+		return _mm256_andnot_si256(eitherZero, _mm256_set1_epi32(1));
+	}
+#endif
+};
+
+struct LogicalOr
+{
+	static int scalar(int x, int y) { return x || y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y)
+	{
+		const auto zero = _mm256_setzero_si256();
+		const auto bothZero = _mm256_and_si256(_mm256_cmpeq_epi32(x, zero), _mm256_cmpeq_epi32(y, zero));
+		return _mm256_andnot_si256(bothZero, _mm256_set1_epi32(1));
+	}
+#endif
+};
+
+// Distinct integers are never approximately equal, so the comparisons can be exact
+
+struct Equal
+{
+	static int scalar(int x, int y) { return x == y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_and_si256(_mm256_cmpeq_epi32(x, y), _mm256_set1_epi32(1)); }
+#endif
+};
+
+struct NotEqual
+{
+	static int scalar(int x, int y) { return x != y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_andnot_si256(_mm256_cmpeq_epi32(x, y), _mm256_set1_epi32(1)); }
+#endif
+};
+
+struct Less
+{
+	static int scalar(int x, int y) { return x < y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_and_si256(_mm256_cmpgt_epi32(y, x), _mm256_set1_epi32(1)); }
+#endif
+};
+
+struct LessOrEqual
+{
+	static int scalar(int x, int y) { return x <= y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_andnot_si256(_mm256_cmpgt_epi32(x, y), _mm256_set1_epi32(1)); }
+#endif
+};
+
+struct Greater
+{
+	static int scalar(int x, int y) { return x > y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_and_si256(_mm256_cmpgt_epi32(x, y), _mm256_set1_epi32(1)); }
+#endif
+};
+
+struct GreaterOrEqual
+{
+	static int scalar(int x, int y) { return x >= y; }
+#if BBGRAPH_AVX2
+	BBGRAPH_AVX2_TARGET static __m256i vector(__m256i x, __m256i y) { return _mm256_andnot_si256(_mm256_cmpgt_epi32(y, x), _mm256_set1_epi32(1)); }
+#endif
+};
+
+#pragma endregion
+
+#pragma region Kernels
+
+#if BBGRAPH_AVX2
+// Processes as many lanes as fit into whole vectors and returns the number of lanes processed
+template <typename Op>
+BBGRAPH_AVX2_TARGET static int binaryAVX2(const int* x, bool xUniform, const int* y, bool yUniform, int* result, int numSamples)
+{
+	const auto xBroadcast = _mm256_set1_epi32(x[0]);
+	const auto yBroadcast = _mm256_set1_epi32(y[0]);
+
+	int i = 0;
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		const auto xValues = xUniform ? xBroadcast : _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+		const auto yValues = yUniform ? yBroadcast : _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i), Op::vector(xValues, yValues));
+	}
+
+	return i;
+}
+#endif
+
+template <typename Op>
+static void binaryKernel(const int* x, bool xUniform, const int* y, bool yUniform, int* result, int numSamples)
+{
+	// The result may overwrite a uniform operand, so its value is read first
+	const auto xValue = x[0];
+	const auto yValue = y[0];
+
+	if (xUniform) x = &xValue;
+	if (yUniform) y = &yValue;
+
+	int i = 0;
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+		i = binaryAVX2<Op>(x, xUniform, y, yUniform, result, numSamples);
+#endif
+
+	for (; i < numSamples; ++i)
+		result[i] = Op::scalar(x[xUniform ? 0 : i], y[yUniform ? 0 : i]);
+}
+
+#pragma endregion
+
+int IntegerLanes::apply(Operation operation, int x, int y)
+{
+	switch (operation)
+	{
+	case bitAnd: return BitAnd::scalar(x, y);
+	case bitOr: return BitOr::scalar(x, y);
+	case bitXor: return BitXor::scalar(x, y);
+	case leftShift: return LeftShift::scalar(x, y);
+	case rightShift: return RightShift::scalar(x, y);
+	case logicalAnd: return LogicalAnd::scalar(x, y);
+	case logicalOr: return LogicalOr::scalar(x, y);
+	case equal: return Equal::scalar(x, y);
+	case notEqual: return NotEqual::scalar(x, y);
+	case less: return Less::scalar(x, y);
+	case lessOrEqual: return LessOrEqual::scalar(x, y);
+	case greater: return Greater::scalar(x, y);
+	case greaterOrEqual: return GreaterOrEqual::scalar(x, y);
+	}
+
+	jassertfalse;
+	return 0;
+}
+
+void IntegerLanes::binary(Operation operation, const int* x, bool xUniform, const int* y, bool yUniform, int* result, int numSamples)
+{
+	jassert(!(xUniform && yUniform));
+
+	switch (operation)
+	{
+	case bitAnd: binaryKernel<BitAnd>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case bitOr: binaryKernel<BitOr>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case bitXor: binaryKernel<BitXor>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case leftShift: binaryKernel<LeftShift>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case rightShift: binaryKernel<RightShift>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case logicalAnd: binaryKernel<LogicalAnd>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case logicalOr: binaryKernel<LogicalOr>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case equal: binaryKernel<Equal>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case notEqual: binaryKernel<NotEqual>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case less: binaryKernel<Less>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case lessOrEqual: binaryKernel<LessOrEqual>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case greater: binaryKernel<Greater>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	case greaterOrEqual: binaryKernel<GreaterOrEqual>(x, xUniform, y, yUniform, result, numSamples);
+		break;
+	}
+}
+
+#if BBGRAPH_AVX2
+BBGRAPH_AVX2_TARGET static int bitNotAVX2(const int* x, int* result, int numSamples)
+{
+	const auto ones = _mm256_set1_epi32(-1);
+
+	int i = 0;
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		const auto values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i), _mm256_xor_si256(values, ones));
+	}
+
+	return i;
+}
+
+BBGRAPH_AVX2_TARGET static int logicalNotAVX2(const int* x, int* result, int numSamples)
+{
+	const auto zero = _mm256_setzero_si256();
+	const auto one = _mm256_set1_epi32(1);
+
+	int i = 0;
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		const auto values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i), _mm256_and_si256(_mm256_cmpeq_epi32(values, zero), one));
+	}
+
+	return i;
+}
+
+BBGRAPH_AVX2_TARGET static int fromSamplesAVX2(const double* x, int* result, int numSamples)
+{
+	int i = 0;
+	for (; i + 4 <= numSamples; i += 4)
+	{
+		const auto values = _mm256_loadu_pd(x + i);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), _mm256_cvttpd_epi32(values));
+	}
+
+	return i;
+}
+
+BBGRAPH_AVX2_TARGET static int fromSamplesAVX2(const float* x, int* result, int numSamples)
+{
+	int i = 0;
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		const auto values = _mm256_loadu_ps(x + i);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i), _mm256_cvttps_epi32(values));
+	}
+
+	return i;
+}
+
+BBGRAPH_AVX2_TARGET static int roundToFloatAVX2(const int* x, int* result, int numSamples)
+{
+	int i = 0;
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		const auto values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i), _mm256_cvttps_epi32(_mm256_cvtepi32_ps(values)));
+	}
+
+	return i;
+}
+
+BBGRAPH_AVX2_TARGET static int toSamplesAVX2(const int* x, double* result, int numSamples)
+{
+	int i = 0;
+	for (; i + 4 <= numSamples; i += 4)
+	{
+		const auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+		_mm256_storeu_pd(result + i, _mm256_cvtepi32_pd(values));
+	}
+
+	return i;
+}
+
+BBGRAPH_AVX2_TARGET static int toSamplesAVX2(const int* x, float* result, int numSamples)
+{
+	int i = 0;
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		const auto values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+		_mm256_storeu_ps(result + i, _mm256_cvtepi32_ps(values));
+	}
+
+	return i;
+}
+#endif
+
+void IntegerLanes::bitNot(const int* x, int* result, int numSamples)
+{
+	int i = 0;
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+		i = bitNotAVX2(x, result, numSamples);
+#endif
+
+	for (; i < numSamples; ++i)
+		result[i] = ~x[i];
+}
+
+void IntegerLanes::logicalNot(const int* x, int* result, int numSamples)
+{
+	int i = 0;
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+		i = logicalNotAVX2(x, result, numSamples);
+#endif
+
+	for (; i < numSamples; ++i)
+		result[i] = !x[i];
+}
+
+template <typename Sample>
+static void fromSamples(const Sample* x, int* result, int numSamples)
+{
+	int i = 0;
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+		i = fromSamplesAVX2(x, result, numSamples);
+#endif
+
+	for (; i < numSamples; ++i)
+		result[i] = (int)x[i];
+}
+
+template <typename Sample>
+static void toSamples(const int* x, Sample* result, int numSamples)
+{
+	int i = 0;
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+		i = toSamplesAVX2(x, result, numSamples);
+#endif
+
+	for (; i < numSamples; ++i)
+		result[i] = (Sample)x[i];
+}
+
+void IntegerLanes::fromSamples(const double* x, int* result, int numSamples)
+{
+	::fromSamples(x, result, numSamples);
+}
+
+void IntegerLanes::fromSamples(const float* x, int* result, int numSamples)
+{
+	::fromSamples(x, result, numSamples);
+}
+
+void IntegerLanes::toSamples(const int* x, double* result, int numSamples)
+{
+	::toSamples(x, result, numSamples);
+}
+
+void IntegerLanes::toSamples(const int* x, float* result, int numSamples)
+{
+	::toSamples(x, result, numSamples);
+}
+
+void IntegerLanes::roundToFloat(const int* x, int* result, int numSamples)
+{
+	int i = 0;
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+		i = roundToFloatAVX2(x, result, numSamples);
+#endif
+
+	for (; i < numSamples; ++i)
+		result[i] = (int)(float)x[i];
+}
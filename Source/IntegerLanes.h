@@ -0,0 +1,47 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Kernels for the integer valued ops of the block processor.
+// The values are int32 lanes, so the AVX2 versions process 8 samples per instruction. If the cpu doesn't support
+// AVX2, plain loops are used instead. At most one of the operands of a binary op may be uniform.
+class IntegerLanes
+{
+public:
+	enum Operation
+	{
+		bitAnd,
+		bitOr,
+		bitXor,
+		leftShift,
+		rightShift,
+
+		logicalAnd,
+		logicalOr,
+
+		equal,
+		notEqual,
+		less,
+		lessOrEqual,
+		greater,
+		greaterOrEqual
+	};
+
+	static int apply(Operation operation, int x, int y);
+
+	static void binary(Operation operation, const int* x, bool xUniform, const int* y, bool yUniform, int* result, int numSamples);
+
+	static void bitNot(const int* x, int* result, int numSamples);
+
+	static void logicalNot(const int* x, int* result, int numSamples);
+
+	// Truncates like a cast to int
+	static void fromSamples(const double* x, int* result, int numSamples);
+	static void fromSamples(const float* x, int* result, int numSamples);
+
+	static void toSamples(const int* x, double* result, int numSamples);
+	static void toSamples(const int* x, float* result, int numSamples);
+
+	// Rounds the values to the nearest float and truncates them again, like storing them as floats does
+	static void roundToFloat(const int* x, int* result, int numSamples);
+};
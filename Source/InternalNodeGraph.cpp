@@ -26,6 +26,11 @@ InternalNodeGraph::ExpressionNode::ExpressionNode(NodeID n) : Node(n, expr_node_
 
 void InternalNodeGraph::ExpressionNode::update()
 {
+	ByteCodeProcessor::MathOptions options;
+	options.precision = (ByteCodeProcessor::Precision)juce::jlimit(0, 2, (int)properties.getWithDefault("precision", 0));
+	options.exactComparisons = properties.getWithDefault("exactComparisons", false);
+	processor->setMathOptions(options);
+
 	const auto valid = processor->update(properties.getWithDefault("expression", "").toString());
 	properties.set("validExpression", valid);
 }
@@ -92,14 +97,12 @@ bool InternalNodeGraph::Connection::operator< (const Connection& other) const no
 InternalNodeGraph::InternalNodeGraph(ByteBeatNodeGraphAudioProcessor& p, ParameterManager& paramManager) : audioProcessor(p), parameterManager(paramManager)
 {}
 
-// This has to be here because GraphRenderSequence is not a complete type in the header.
 InternalNodeGraph::~InternalNodeGraph()
 {}
 
 void InternalNodeGraph::clear()
 {
-	const juce::ScopedLock sl(audioProcessor.getCallbackLock());
-
+	// The audio thread only renders the compiled sequences, changing the nodes doesn't have to wait for it
 	if (nodes.isEmpty())
 		return;
 
@@ -162,10 +165,7 @@ InternalNodeGraph::Node::Ptr InternalNodeGraph::addNode(NodeType nodeType, NodeI
 		//default: break;
 	}
 
-	{
-		const juce::ScopedLock sl();
-		nodes.add(n.get());
-	}
+	nodes.add(n.get());
 
 	if (!quiet) topologyChanged();
 	return n;
@@ -173,8 +173,6 @@ InternalNodeGraph::Node::Ptr InternalNodeGraph::addNode(NodeType nodeType, NodeI
 
 InternalNodeGraph::Node::Ptr InternalNodeGraph::removeNode(NodeID nodeID)
 {
-	const juce::ScopedLock sl(audioProcessor.getCallbackLock());
-
 	for (int i = nodes.size(); --i >= 0;)
 	{
 		if (nodes.getUnchecked(i)->nodeID == nodeID)
@@ -395,6 +393,31 @@ bool InternalNodeGraph::removeIllegalConnections()
 	return anyRemoved;
 }
 
+void InternalNodeGraph::nodeChanged(NodeID nodeID)
+{
+	if (auto* node = getNodeForId(nodeID))
+	{
+		node->update();
+		topologyChanged();
+	}
+}
+
+void InternalNodeGraph::setSinglePrecision(bool shouldUseFloats)
+{
+	if (singlePrecision == shouldUseFloats) return;
+
+	singlePrecision = shouldUseFloats;
+	topologyChanged();
+}
+
+void InternalNodeGraph::setRenderRate(double newRenderRate)
+{
+	if (renderRate == newRenderRate) return;
+
+	renderRate = newRenderRate;
+	topologyChanged();
+}
+
 juce::ValueTree InternalNodeGraph::toValueTree() const
 {
 	juce::ValueTree graphTree("graph");
@@ -429,6 +452,8 @@ juce::ValueTree InternalNodeGraph::toValueTree() const
 	
 	graphTree.addChild(nodesTree, 0, nullptr);
 	graphTree.addChild(connectionsTree, 1, nullptr);
+	graphTree.setProperty("singlePrecision", singlePrecision, nullptr);
+	graphTree.setProperty("renderRate", renderRate, nullptr);
 
 	return graphTree;
 }
@@ -438,6 +463,9 @@ void InternalNodeGraph::restoreFromTree(const juce::ValueTree& graphTree)
 {
 	clear();
 
+	singlePrecision = graphTree.getProperty("singlePrecision", false);
+	renderRate = graphTree.getProperty("renderRate", 0.0);
+
 	const juce::ValueTree nodesTree = graphTree.getChildWithName("nodes");
 	const juce::ValueTree connectionsTree = graphTree.getChildWithName("connections");
 	
@@ -510,9 +538,39 @@ void InternalNodeGraph::buildRenderingSequence()
 {
 	auto newSequence = std::make_unique<GraphRenderSequence>(*this);
 
-	std::swap(renderSequence, newSequence);
+	updateNodeStatus(newSequence->getFusedGraph());
+
+	// The audio thread owns the sequence from here on
+	audioProcessor.setNodeProcessorSequence(std::move(newSequence));
+}
+
+void InternalNodeGraph::updateNodeStatus(const FusedGraph& fusedGraph)
+{
+	bool changed = false;
+
+	const auto setStatus = [&changed](Node* node, const juce::Identifier& name, const juce::var& value)
+	{
+		if (node->properties[name] == value) return;
+
+		if (value.isVoid())
+			node->properties.remove(name);
+		else
+			node->properties.set(name, value);
+
+		changed = true;
+	};
+
+	for (auto* node : nodes)
+	{
+		// The uid of the node whose value is used instead
+		const auto shared = fusedGraph.sharedNodes.find(node->nodeID);
+		setStatus(node, "sharedWith", shared != fusedGraph.sharedNodes.end() ? juce::var((int)shared->second.uid) : juce::var());
+
+		const auto excluded = fusedGraph.excludedNodes.count(node->nodeID) != 0;
+		setStatus(node, "excluded", excluded ? juce::var(true) : juce::var());
+	}
 
-	audioProcessor.setNodeProcessorSequence(*renderSequence);
+	if (changed) sendChangeMessage();
 }
 
 #pragma endregion
@@ -5,6 +5,7 @@
 #include "ByteCodeProcessor.h"
 #include "ParameterManager.h"
 
+class FusedGraph;
 struct GraphRenderSequence;
 
 class ByteBeatNodeGraphAudioProcessor;
@@ -68,6 +69,7 @@ public:
 	protected:
 		friend class InternalNodeGraph;
 		friend struct GraphRenderSequence;
+		friend class FusedGraph;
 
 		struct Connection
 		{
@@ -103,11 +105,9 @@ public:
 
 		void update() override;
 
+		// Only used on the message thread, to check the expression and as the source FusedGraph compiles from.
+		// Edits reach the voices as a new RenderState.
 		std::unique_ptr<ByteCodeProcessor> processor;
-
-	private:
-		std::vector<float> inputValues;
-		float t;
 	};
 
 	class OutputNode : public Node
@@ -183,6 +183,22 @@ public:
 	bool isConnectionLegal(const Connection&) const;
 
 	bool removeIllegalConnections();
+
+	// Updates a node after its properties were changed. The render sequence is built again, because it compiles
+	// the expressions of all nodes into one program.
+	void nodeChanged(NodeID);
+
+	// Evaluates the graph with floats instead of doubles. Floats are faster, but integers above 2^24
+	// like large f and p lose their lowest bits.
+	void setSinglePrecision(bool shouldUseFloats);
+
+	bool isSinglePrecision() const noexcept { return singlePrecision; }
+
+	// Renders the graph at a lower rate than the host, like 8000 for classic bytebeats, and resamples the output
+	// to the host rate. 0 renders at the host rate, which is also used if the host rate is lower.
+	void setRenderRate(double newRenderRate);
+
+	double getRenderRate() const noexcept { return renderRate; }
 	
 	juce::ValueTree toValueTree() const;
 
@@ -193,13 +209,16 @@ private:
 	ParameterManager& parameterManager;
 	juce::ReferenceCountedArray<Node> nodes;
 	NodeID lastNodeID = {};
-	
-	std::unique_ptr<GraphRenderSequence> renderSequence;
+	bool singlePrecision = false;
+	double renderRate = 0;
 	
 	void topologyChanged();
 	void handleAsyncUpdate() override;
 	void buildRenderingSequence();
 
+	// Sets the properties that show the editor how the render sequence evaluates the nodes
+	void updateNodeStatus(const FusedGraph& fusedGraph);
+
 	bool isConnected(Node* src, int sourceChannel, Node* dest, int destChannel) const noexcept;
 	bool isAnInputTo(Node& src, Node& dst, int recursionCheck) const noexcept;
 	bool canConnect(Node* src, int sourceChannel, Node* dest, int destChannel) const noexcept;
@@ -0,0 +1,605 @@
+#include "NativeCode.h"
+
+#include "FastMath.h"
+#include "RandomGenerator.h"
+
+#if JUCE_INTEL && JUCE_64BIT
+#if JUCE_WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#define BBGRAPH_NATIVE_CODE 1
+#else
+#define BBGRAPH_NATIVE_CODE 0
+#endif
+
+#if BBGRAPH_NATIVE_CODE
+
+#pragma region Helpers
+
+// Ops that are too complex to inline are called as plain functions, so the results match the interpreter exactly.
+
+template <typename Sample> static Sample nativeModulo(Sample x, Sample y) { return std::fmod(x, y); }
+template <typename Sample> static Sample nativeLeftShift(Sample x, Sample y) { return (Sample)((long)x << (int)y); }
+template <typename Sample> static Sample nativeEqual(Sample x, Sample y) { return juce::approximatelyEqual(x, y); }
+template <typename Sample> static Sample nativeNotEqual(Sample x, Sample y) { return !juce::approximatelyEqual(x, y); }
+template <typename Sample> static Sample nativeLessOrEqual(Sample x, Sample y) { return x < y || juce::approximatelyEqual(x, y); }
+template <typename Sample> static Sample nativeGreaterOrEqual(Sample x, Sample y) { return x > y || juce::approximatelyEqual(x, y); }
+template <typename Sample> static Sample nativePower(Sample x, Sample y) { return std::pow(x, y); }
+template <typename Sample> static Sample nativeCbrt(Sample x) { return std::cbrt(x); }
+template <typename Sample> static Sample nativeExp(Sample x) { return std::exp(x); }
+template <typename Sample> static Sample nativeExp2(Sample x) { return std::exp2(x); }
+template <typename Sample> static Sample nativeLog(Sample x) { return std::log(x); }
+template <typename Sample> static Sample nativeLog2(Sample x) { return std::log2(x); }
+template <typename Sample> static Sample nativeLog10(Sample x) { return std::log10(x); }
+template <typename Sample> static Sample nativeSine(Sample x) { return std::sin(x); }
+template <typename Sample> static Sample nativeCosine(Sample x) { return std::cos(x); }
+template <typename Sample> static Sample nativeTangent(Sample x) { return std::tan(x); }
+template <typename Sample> static Sample nativeArcsine(Sample x) { return std::asin(x); }
+template <typename Sample> static Sample nativeArccosine(Sample x) { return std::acos(x); }
+template <typename Sample> static Sample nativeArctangent(Sample x) { return std::atan(x); }
+template <typename Sample> static Sample nativeRandom(RandomGenerator* random) { return random->next<Sample>(); }
+
+// The approximations of FastMath work on doubles, floats are converted on the way
+template <typename Sample, double (*function)(double)>
+static Sample nativeFastMath(Sample x) { return (Sample)function(x); }
+
+template <typename Sample>
+static Sample nativeFastPower(Sample x, Sample y) { return (Sample)FastMath::power(x, y); }
+
+#pragma endregion
+
+#pragma region Assembler
+
+// Emits the few x86-64 instructions the code generator needs.
+// General purpose registers are given by their encoding, xmm registers by their number.
+class Assembler
+{
+public:
+	enum Register { rax = 0, rcx = 1, rdx = 2, rbx = 3, rsp = 4, rbp = 5, rsi = 6, rdi = 7, r8 = 8, r14 = 14, r15 = 15 };
+
+	std::vector<juce::uint8> code;
+
+	void emit(std::initializer_list<juce::uint8> bytes) { code.insert(code.end(), bytes); }
+
+	void emit32(juce::uint32 value)
+	{
+		for (int i = 0; i < 4; ++i)
+			code.push_back((juce::uint8)(value >> (i * 8)));
+	}
+
+	void emit64(juce::uint64 value)
+	{
+		for (int i = 0; i < 8; ++i)
+			code.push_back((juce::uint8)(value >> (i * 8)));
+	}
+
+	void push(Register reg)
+	{
+		if (reg >= 8) emit({ 0x41 });
+		emit({ (juce::uint8)(0x50 + (reg & 7)) });
+	}
+
+	void pop(Register reg)
+	{
+		if (reg >= 8) emit({ 0x41 });
+		emit({ (juce::uint8)(0x58 + (reg & 7)) });
+	}
+
+	// mov dst, src (64 bit)
+	void move(Register dst, Register src)
+	{
+		emit({ (juce::uint8)(0x48 | (src >= 8 ? 0x04 : 0) | (dst >= 8 ? 0x01 : 0)), 0x89,
+			(juce::uint8)(0xC0 | ((src & 7) << 3) | (dst & 7)) });
+	}
+
+	// mov dst, [base + displacement] (64 bit)
+	void load(Register dst, Register base, int displacement)
+	{
+		emit({ (juce::uint8)(0x48 | (dst >= 8 ? 0x04 : 0) | (base >= 8 ? 0x01 : 0)), 0x8B,
+			(juce::uint8)(0x80 | ((dst & 7) << 3) | (base & 7)) });
+		emit32((juce::uint32)displacement);
+	}
+
+	void adjustStackPointer(int bytes)
+	{
+		// add rsp, imm8 / sub rsp, imm8
+		emit({ 0x48, 0x83, (juce::uint8)(bytes > 0 ? 0xC4 : 0xEC), (juce::uint8)std::abs(bytes) });
+	}
+
+	void moveImmediate(juce::uint64 value)
+	{
+		// mov rax, imm64
+		emit({ 0x48, 0xB8 });
+		emit64(value);
+	}
+
+	// SSE op with a register operand: op xmm(dst), xmm(src). A prefix of 0 is left out.
+	void sse(juce::uint8 prefix, juce::uint8 opcode, int dst, int src)
+	{
+		if (prefix != 0) emit({ prefix });
+		emit({ 0x0F, opcode, (juce::uint8)(0xC0 | (dst << 3) | src) });
+	}
+
+	// SSE op with a memory operand: op xmm(reg), [base + displacement]
+	// Also used for movsd stores, where the memory operand is the destination.
+	void sse(juce::uint8 prefix, juce::uint8 opcode, int reg, Register base, int displacement)
+	{
+		if (prefix != 0) emit({ prefix });
+		if (base >= 8) emit({ 0x41 });
+		emit({ 0x0F, opcode, (juce::uint8)(0x80 | (reg << 3) | (base & 7)) });
+		emit32((juce::uint32)displacement);
+	}
+
+	// movq xmm, rax
+	void moveToXmm(int xmm)
+	{
+		emit({ 0x66, 0x48, 0x0F, 0x6E, (juce::uint8)(0xC0 | (xmm << 3)) });
+	}
+
+	void loadConstant(int xmm, double value)
+	{
+		juce::uint64 bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		moveImmediate(bits);
+		moveToXmm(xmm);
+	}
+
+	// The float ends up in the lowest 32 bits of the register
+	void loadConstant(int xmm, float value)
+	{
+		juce::uint32 bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		moveImmediate(bits);
+		moveToXmm(xmm);
+	}
+
+	void call(const void* function)
+	{
+		moveImmediate((juce::uint64)function);
+		// call rax
+		emit({ 0xFF, 0xD0 });
+	}
+};
+
+#pragma endregion
+
+template <typename Sample>
+std::unique_ptr<NativeCode<Sample>> NativeCode<Sample>::compile(const std::vector<ByteCodeProcessor::Op>& byteCode,
+	const std::vector<double>& numberConstants, const ByteCodeProcessor::MathOptions& options)
+{
+	using Op = ByteCodeProcessor::Op;
+	using Precision = ByteCodeProcessor::Precision;
+	using Reg = Assembler::Register;
+
+	if (byteCode.empty()) return nullptr;
+
+	// The pointer arguments are kept in callee saved registers, so they survive the helper calls.
+	constexpr auto inputs = Reg::rbx;
+	constexpr auto globals = Reg::r14;
+	constexpr auto stack = Reg::r15;
+
+	// Opcodes. The scalar instructions for floats and doubles only differ in the prefix. Of the packed ones,
+	// which are used on single values too, the double versions have a prefix and the float versions none.
+	constexpr auto isFloat = std::is_same<Sample, float>::value;
+	constexpr juce::uint8 ss = isFloat ? 0xF3 : 0xF2, ps = isFloat ? 0x00 : 0x66;
+	constexpr juce::uint8 movsLoad = 0x10, movsStore = 0x11, movap = 0x28, cvtsi2s = 0x2A, cvtts2si = 0x2C,
+		ucomis = 0x2E, sqrts = 0x51, andp = 0x54, xorp = 0x57, adds = 0x58, muls = 0x59, subs = 0x5C, divs = 0x5E,
+		cmps = 0xC2;
+
+	Assembler as;
+
+	as.push(Reg::rbx);
+	as.push(Reg::r14);
+	as.push(Reg::r15);
+	// Shadow space for the helper calls on windows. It also keeps the stack 16 byte aligned.
+	as.adjustStackPointer(-32);
+
+#if JUCE_WINDOWS
+	as.move(inputs, Reg::rcx);
+	as.move(globals, Reg::rdx);
+	as.move(stack, Reg::r8);
+#else
+	as.move(inputs, Reg::rdi);
+	as.move(globals, Reg::rsi);
+	as.move(stack, Reg::rdx);
+#endif
+
+	// The top of the stack is cached in xmm0, all values below it live in the stack memory.
+	int depth = 0;
+	int nextNum = 0;
+
+	const auto slot = [&depth](int fromTop) { return (depth - 1 - fromTop) * (int)sizeof(Sample); };
+
+	const auto pushGlobal = [&](size_t offset)
+	{
+		if (depth > 0) as.sse(ss, movsStore, 0, stack, slot(0));
+		as.sse(ss, movsLoad, 0, globals, (int)offset);
+		++depth;
+	};
+
+	const auto pushInput = [&](int index)
+	{
+		if (depth > 0) as.sse(ss, movsStore, 0, stack, slot(0));
+		as.sse(ss, movsLoad, 0, inputs, index * (int)sizeof(Sample));
+		++depth;
+	};
+
+	const auto pushValue = [&](int index)
+	{
+		if (depth > 0) as.sse(ss, movsStore, 0, stack, slot(0));
+		as.load(Reg::rax, globals, (int)offsetof(GlobalValues<Sample>, values));
+		as.sse(ss, movsLoad, 0, Reg::rax, index * (int)sizeof(Sample));
+		++depth;
+	};
+
+	const auto pushConstant = [&](Sample value)
+	{
+		if (depth > 0) as.sse(ss, movsStore, 0, stack, slot(0));
+		as.loadConstant(0, value);
+		++depth;
+	};
+
+	const auto pushRandom = [&]()
+	{
+		if (depth > 0) as.sse(ss, movsStore, 0, stack, slot(0));
+#if JUCE_WINDOWS
+		as.load(Reg::rcx, globals, (int)offsetof(GlobalValues<Sample>, random));
+#else
+		as.load(Reg::rdi, globals, (int)offsetof(GlobalValues<Sample>, random));
+#endif
+		as.call((const void*)nativeRandom<Sample>);
+		++depth;
+	};
+
+	// x is loaded into xmm0 and y into xmm1
+	const auto loadOperands = [&]()
+	{
+		as.sse(ps, movap, 1, 0);
+		as.sse(ss, movsLoad, 0, stack, slot(1));
+	};
+
+	const auto binary = [&](juce::uint8 opcode)
+	{
+		loadOperands();
+		as.sse(ss, opcode, 0, 1);
+		--depth;
+	};
+
+	const auto binaryCall = [&](Sample (*function)(Sample, Sample))
+	{
+		loadOperands();
+		as.call((const void*)function);
+		--depth;
+	};
+
+	// Converts x to eax and y to ecx like the (int) casts of the interpreter
+	const auto loadIntOperands = [&]()
+	{
+		as.sse(ss, cvtts2si, Reg::rcx, 0);
+		as.sse(ss, cvtts2si, Reg::rax, stack, slot(1));
+	};
+
+	const auto binaryInt = [&](std::initializer_list<juce::uint8> instruction)
+	{
+		loadIntOperands();
+		as.emit(instruction);
+		as.sse(ss, cvtsi2s, 0, Reg::rax);
+		--depth;
+	};
+
+	const auto binaryLogical = [&](juce::uint8 opcode)
+	{
+		loadIntOperands();
+		// test eax, eax; setne al; test ecx, ecx; setne cl; op al, cl; movzx eax, al
+		as.emit({ 0x85, 0xC0, 0x0F, 0x95, 0xC0, 0x85, 0xC9, 0x0F, 0x95, 0xC1, opcode, 0xC8, 0x0F, 0xB6, 0xC0 });
+		as.sse(ss, cvtsi2s, 0, Reg::rax);
+		--depth;
+	};
+
+	// Sets xmm0 to 1 if the condition of the comparison is met, else to 0. The instructions compute it into al.
+	const auto setFromFlags = [&](std::initializer_list<juce::uint8> condition)
+	{
+		as.emit(condition);
+		// movzx eax, al
+		as.emit({ 0x0F, 0xB6, 0xC0 });
+		as.sse(ss, cvtsi2s, 0, Reg::rax);
+		--depth;
+	};
+
+	const auto unaryInt = [&](std::initializer_list<juce::uint8> instruction)
+	{
+		as.sse(ss, cvtts2si, Reg::rax, 0);
+		as.emit(instruction);
+		as.sse(ss, cvtsi2s, 0, Reg::rax);
+	};
+
+	const auto unaryCall = [&](Sample (*function)(Sample))
+	{
+		as.call((const void*)function);
+	};
+
+	// The function for the precision of the options
+	const auto withPrecision = [&options](Sample (*exact)(Sample), Sample (*polynomial)(Sample), Sample (*table)(Sample))
+	{
+		switch (options.precision)
+		{
+		case Precision::polynomial: return polynomial;
+		case Precision::table: return table;
+		default: return exact;
+		}
+	};
+
+	for (const auto op : byteCode)
+	{
+		switch (op)
+		{
+		case Op::invert:
+			as.loadConstant(1, (Sample)-0.0);
+			as.sse(ps, xorp, 0, 1);
+			break;
+		case Op::add: as.sse(ss, adds, 0, stack, slot(1));
+			--depth;
+			break;
+		case Op::subtract: binary(subs);
+			break;
+		case Op::multiply: as.sse(ss, muls, 0, stack, slot(1));
+			--depth;
+			break;
+		case Op::divide: binary(divs);
+			break;
+		case Op::modulo: binaryCall(nativeModulo<Sample>);
+			break;
+
+		case Op::bitnot: unaryInt({ 0xF7, 0xD0 }); // not eax
+			break;
+		case Op::bitand: binaryInt({ 0x21, 0xC8 }); // and eax, ecx
+			break;
+		case Op::bitor: binaryInt({ 0x09, 0xC8 }); // or eax, ecx
+			break;
+		case Op::bitxor: binaryInt({ 0x31, 0xC8 }); // xor eax, ecx
+			break;
+		case Op::lshift: binaryCall(nativeLeftShift<Sample>);
+			break;
+		case Op::rshift: binaryInt({ 0xD3, 0xF8 }); // sar eax, cl
+			break;
+
+		case Op::not: unaryInt({ 0x85, 0xC0, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0 }); // test eax, eax; sete al; movzx eax, al
+			break;
+		case Op::and: binaryLogical(0x20); // and al, cl
+			break;
+		case Op::or: binaryLogical(0x08); // or al, cl
+			break;
+
+		// Unordered operands set the parity flag, so NaN compares like in C++
+		case Op::equal:
+			if (options.exactComparisons)
+			{
+				as.sse(ps, ucomis, 0, stack, slot(1));
+				setFromFlags({ 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8 }); // sete al; setnp cl; and al, cl
+			}
+			else binaryCall(nativeEqual<Sample>);
+			break;
+		case Op::notequal:
+			if (options.exactComparisons)
+			{
+				as.sse(ps, ucomis, 0, stack, slot(1));
+				setFromFlags({ 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8 }); // setne al; setp cl; or al, cl
+			}
+			else binaryCall(nativeNotEqual<Sample>);
+			break;
+		case Op::less: // y > x
+			as.sse(ps, ucomis, 0, stack, slot(1));
+			setFromFlags({ 0x0F, 0x97, 0xC0 }); // seta al
+			break;
+		case Op::lessorequal: // y >= x
+			if (options.exactComparisons)
+			{
+				as.sse(ps, ucomis, 0, stack, slot(1));
+				setFromFlags({ 0x0F, 0x93, 0xC0 }); // setae al
+			}
+			else binaryCall(nativeLessOrEqual<Sample>);
+			break;
+		case Op::greater: // x > y
+			as.sse(ss, movsLoad, 1, stack, slot(1));
+			as.sse(ps, ucomis, 1, 0);
+			setFromFlags({ 0x0F, 0x97, 0xC0 }); // seta al
+			break;
+		case Op::greaterorequal: // x >= y
+			if (options.exactComparisons)
+			{
+				as.sse(ss, movsLoad, 1, stack, slot(1));
+				as.sse(ps, ucomis, 1, 0);
+				setFromFlags({ 0x0F, 0x93, 0xC0 }); // setae al
+			}
+			else binaryCall(nativeGreaterOrEqual<Sample>);
+			break;
+
+		case Op::power:
+			if (options.precision != Precision::exact) binaryCall(nativeFastPower<Sample>);
+			else binaryCall(nativePower<Sample>);
+			break;
+
+		case Op::sqrt: as.sse(ss, sqrts, 0, 0);
+			break;
+		case Op::cbrt: unaryCall(nativeCbrt<Sample>);
+			break;
+
+		case Op::exp: unaryCall(withPrecision(nativeExp<Sample>, nativeFastMath<Sample, FastMath::exp>, nativeFastMath<Sample, FastMath::exp>));
+			break;
+		case Op::exp2: unaryCall(withPrecision(nativeExp2<Sample>, nativeFastMath<Sample, FastMath::exp2>, nativeFastMath<Sample, FastMath::exp2>));
+			break;
+		case Op::log: unaryCall(withPrecision(nativeLog<Sample>, nativeFastMath<Sample, FastMath::log>, nativeFastMath<Sample, FastMath::log>));
+			break;
+		case Op::log2: unaryCall(withPrecision(nativeLog2<Sample>, nativeFastMath<Sample, FastMath::log2>, nativeFastMath<Sample, FastMath::log2>));
+			break;
+		case Op::log10: unaryCall(withPrecision(nativeLog10<Sample>, nativeFastMath<Sample, FastMath::log10>, nativeFastMath<Sample, FastMath::log10>));
+			break;
+
+		case Op::absolute:
+			as.moveImmediate(isFloat ? 0x7FFFFFFF : 0x7FFFFFFFFFFFFFFF);
+			as.moveToXmm(1);
+			as.sse(ps, andp, 0, 1);
+			break;
+
+		case Op::sine: unaryCall(withPrecision(nativeSine<Sample>, nativeFastMath<Sample, FastMath::sine>, nativeFastMath<Sample, FastMath::tableSine>));
+			break;
+		case Op::cosine: unaryCall(withPrecision(nativeCosine<Sample>, nativeFastMath<Sample, FastMath::cosine>, nativeFastMath<Sample, FastMath::tableCosine>));
+			break;
+		case Op::tangent: unaryCall(withPrecision(nativeTangent<Sample>, nativeFastMath<Sample, FastMath::tangent>, nativeFastMath<Sample, FastMath::tableTangent>));
+			break;
+		case Op::arcsine: unaryCall(nativeArcsine<Sample>);
+			break;
+		case Op::arccosine: unaryCall(nativeArccosine<Sample>);
+			break;
+		case Op::arctangent: unaryCall(nativeArctangent<Sample>);
+			break;
+
+		// x - x is NaN for infinity and NaN. Comparing it with itself for ordered gives a mask that keeps the finite x.
+		case Op::finite:
+			as.sse(ps, movap, 1, 0);
+			as.sse(ss, subs, 1, 0);
+			as.sse(ss, cmps, 1, 1);
+			as.emit({ 0x07 }); // ord
+			as.sse(ps, andp, 0, 1);
+			break;
+
+		case Op::numberConstant: pushConstant((Sample)numberConstants[nextNum++]);
+			break;
+
+		case Op::pi: pushConstant((Sample)juce::MathConstants<double>::pi);
+			break;
+		case Op::twopi: pushConstant((Sample)juce::MathConstants<double>::twoPi);
+			break;
+		case Op::halfpi: pushConstant((Sample)juce::MathConstants<double>::halfPi);
+			break;
+		case Op::e: pushConstant((Sample)juce::MathConstants<double>::euler);
+			break;
+
+		case Op::random: pushRandom();
+			break;
+
+		case Op::fs: pushGlobal(offsetof(GlobalValues<Sample>, fs));
+			break;
+		case Op::f: pushGlobal(offsetof(GlobalValues<Sample>, f));
+			break;
+		case Op::ps: pushGlobal(offsetof(GlobalValues<Sample>, ps));
+			break;
+		case Op::p: pushGlobal(offsetof(GlobalValues<Sample>, p));
+			break;
+		case Op::rs: pushGlobal(offsetof(GlobalValues<Sample>, rs));
+			break;
+		case Op::r: pushGlobal(offsetof(GlobalValues<Sample>, r));
+			break;
+		case Op::n: pushGlobal(offsetof(GlobalValues<Sample>, n));
+			break;
+		case Op::t: pushGlobal(offsetof(GlobalValues<Sample>, t));
+			break;
+
+		case Op::nf: pushGlobal(offsetof(GlobalValues<Sample>, nf));
+			break;
+		case Op::sr: pushGlobal(offsetof(GlobalValues<Sample>, sr));
+			break;
+		case Op::bps: pushGlobal(offsetof(GlobalValues<Sample>, bps));
+			break;
+
+		case Op::a: pushInput(0);
+			break;
+		case Op::b: pushInput(1);
+			break;
+		case Op::c: pushInput(2);
+			break;
+		case Op::d: pushInput(3);
+			break;
+
+		// Cached values are stored after the inputs
+		case Op::cachedValue: pushInput(expr_node_num_ins + (int)numberConstants[nextNum++]);
+			break;
+
+		case Op::nodeValue: pushValue((int)numberConstants[nextNum++]);
+			break;
+
+		default:
+			// Not a valid op in postfix byte code
+			return nullptr;
+		}
+	}
+
+	if (depth != 1) return nullptr;
+
+	// The result is returned in xmm0
+	as.adjustStackPointer(32);
+	as.pop(Reg::r15);
+	as.pop(Reg::r14);
+	as.pop(Reg::rbx);
+	as.emit({ 0xC3 }); // ret
+
+	const auto size = as.code.size();
+
+#if JUCE_WINDOWS
+	auto* memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (memory == nullptr) return nullptr;
+
+	std::memcpy(memory, as.code.data(), size);
+
+	DWORD oldProtection;
+	if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &oldProtection))
+	{
+		VirtualFree(memory, 0, MEM_RELEASE);
+		return nullptr;
+	}
+#else
+	auto* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) return nullptr;
+
+	std::memcpy(memory, as.code.data(), size);
+
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(memory, size);
+		return nullptr;
+	}
+#endif
+
+	return std::unique_ptr<NativeCode>(new NativeCode(memory, size));
+}
+
+template <typename Sample>
+NativeCode<Sample>::NativeCode(void* m, size_t s) : memory(m), size(s), function(reinterpret_cast<Function>(m))
+{
+}
+
+template <typename Sample>
+NativeCode<Sample>::~NativeCode()
+{
+#if JUCE_WINDOWS
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, size);
+#endif
+}
+
+#else
+
+template <typename Sample>
+std::unique_ptr<NativeCode<Sample>> NativeCode<Sample>::compile(const std::vector<ByteCodeProcessor::Op>&,
+	const std::vector<double>&, const ByteCodeProcessor::MathOptions&)
+{
+	return nullptr;
+}
+
+template <typename Sample>
+NativeCode<Sample>::NativeCode(void* m, size_t s) : memory(m), size(s), function(nullptr)
+{
+}
+
+template <typename Sample>
+NativeCode<Sample>::~NativeCode()
+{
+}
+
+#endif
+
+template class NativeCode<double>;
+template class NativeCode<float>;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "ByteCodeProcessor.h"
+
+// Machine code for the postfix byte code of a ByteCodeProcessor.
+// The code is generated into an executable buffer owned by this object. Only x86-64 is supported,
+// compile returns nullptr on other platforms or if the code can't be generated.
+// Doubles are computed with the scalar double instructions of SSE2, floats with the single precision ones.
+template <typename Sample>
+class NativeCode
+{
+public:
+	~NativeCode();
+
+	static std::unique_ptr<NativeCode> compile(const std::vector<ByteCodeProcessor::Op>& byteCode,
+		const std::vector<double>& numberConstants, const ByteCodeProcessor::MathOptions& options);
+
+	// The stack has to hold at least as many values as the byte code needs
+	Sample run(const Sample* inputValues, const GlobalValues<Sample>& globalValues, Sample* stack) const
+	{
+		return function(inputValues, &globalValues, stack);
+	}
+
+private:
+	using Function = Sample (*)(const Sample* inputValues, const GlobalValues<Sample>* globalValues, Sample* stack);
+
+	NativeCode(void* memory, size_t size);
+
+	void* memory;
+	size_t size;
+	Function function;
+
+	JUCE_DECLARE_NON_COPYABLE(NativeCode)
+};
@@ -1,118 +1,474 @@
 #include "NodeProcessor.h"
 
-void ExpressionNodeProcessor::processNextValue()
+template <typename Sample>
+TypedNodeProcessorSequence<Sample>::Plan::Plan(int leftValue, int rightValue) : left(leftValue), right(rightValue)
 {
-	for (int i = 0; i < expr_node_num_ins; ++i)
-	{
-		auto& input = inputs[i];
+}
 
-		double value = 0;
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::Plan::addProgram(const ByteCodeProcessor& processor, bool shared, int controlInterval, bool interpolate)
+{
+	const auto isLaneable = controlInterval == 0 && !processor.usesRandom();
 
-		for (const auto inputConnection : input)
-		{
-			value += inputConnection->outValue;
-		}
+	if (processor.getRate() == ByteCodeProcessor::Rate::sample)
+	{
+		(shared ? sharedSamplePrograms : voiceSamplePrograms).push_back((int)programs.size());
 
-		inputValues[i] = value;
+		if (!shared && !isLaneable)
+			isBlockwise = false;
 	}
 
-	outValue = processor.process(inputValues, globalValues);
+	const auto inputOffset = (int)initialState.size();
+	const auto frameOffset = inputOffset + expr_node_num_ins + processor.getNumCachedValues();
+
+	initialState.resize((size_t)(frameOffset + processor.getFrameSize<Sample>()), 0);
+	processor.initialiseFrame(initialState.data() + frameOffset);
+
+	programs.push_back({ &processor, nullptr, processor.getRate(), shared, controlInterval, interpolate, isLaneable,
+		inputOffset, frameOffset });
 }
 
-void OutputNodeProcessor::processNextValue()
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::Plan::addParameter(juce::AudioParameterFloat& parameter)
 {
-	double value = 0;
-
-	const auto& input = inputs[0];
+	programs.push_back({ nullptr, &parameter, ByteCodeProcessor::Rate::block, true, 0, false, false, 0, 0 });
+}
 
-	for (const auto inputConnection : input)
-	{
-		value += inputConnection->outValue;
-	}
+template <typename Sample>
+TypedNodeProcessorSequence<Sample>::TypedNodeProcessorSequence(std::unique_ptr<const Plan> newPlan)
+	: ownedPlan(std::move(newPlan)), plan(*ownedPlan), sharedSequence(nullptr), samplePrograms(plan.sharedSamplePrograms),
+	arena(plan.initialState.size() + plan.programs.size()), values(arena.data() + plan.initialState.size()),
+	controlStates(plan.programs.size())
+{
+	std::copy(plan.initialState.begin(), plan.initialState.end(), arena.begin());
 
-	outValue = static_cast<juce::uint8>(value) / 128.0 - 1.0;
+	globalValues.random = &random;
+	globalValues.values = values;
 }
 
-void ParameterNodeProcessor::processNextValue()
+template <typename Sample>
+TypedNodeProcessorSequence<Sample>::TypedNodeProcessorSequence(const TypedNodeProcessorSequence* shared)
+	: plan(shared->plan), sharedSequence(shared), samplePrograms(plan.voiceSamplePrograms),
+	arena(plan.initialState.size() + plan.programs.size()), values(arena.data() + plan.initialState.size()),
+	controlStates(plan.programs.size())
 {
-	outValue = parameter.get();
+	std::copy(plan.initialState.begin(), plan.initialState.end(), arena.begin());
+
+	globalValues.random = &random;
+	globalValues.values = values;
 }
 
-void NodeProcessorSequence::startNote(double sampleRate, double noteFrequency)
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::startNote(double sampleRate, double noteFrequency, juce::uint64 randomSeed)
 {
-	globalValues.rs = 0;
-	globalValues.r = 0;
-	globalValues.n = 0;
-	globalValues.nf = noteFrequency;
-	globalValues.t = 0;
+	random.seed(randomSeed);
+
+	exactValues.rs = 0;
+	exactValues.r = 0;
+	exactValues.n = 0;
+	exactValues.nf = noteFrequency;
+	exactValues.t = 0;
 	deltaN = noteFrequency * 256 / sampleRate;
+
+	restartControlPrograms();
+	updateGlobalValues();
+	updateValues(ByteCodeProcessor::Rate::note);
 }
 
-void NodeProcessorSequence::prepareToPlay(double sampleRate)
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-	globalValues.fs = 0;
-	globalValues.f = 0;
-	globalValues.ps = 0;
-	globalValues.p = 0;
-	globalValues.rs = 0;
-	globalValues.r = 0;
-	globalValues.n = 0;
-	globalValues.t = 0;
+	exactValues.fs = 0;
+	exactValues.f = 0;
+	exactValues.ps = 0;
+	exactValues.p = 0;
+	exactValues.rs = 0;
+	exactValues.r = 0;
+	exactValues.n = 0;
+	exactValues.t = 0;
 
-	globalValues.sr = sampleRate;
+	exactValues.sr = sampleRate;
 	deltaT = 8000 / sampleRate;
 	deltaS = 1 / sampleRate;
+
+	// Below the host rate, the grid of the render rate can put one more sample into a block
+	if (isSharedSequence())
+		sampleValues.resize((size_t)(samplesPerBlock + 1) * samplePrograms.size());
+
+	restartControlPrograms();
+	updateGlobalValues();
+
+	// The note values can depend on the sample rate
+	updateValues(ByteCodeProcessor::Rate::note);
 }
 
-void NodeProcessorSequence::sync(bool _isPlaying, double bps, double freeSeconds, double freeSamples,
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::sync(bool _isPlaying, double bps, double freeSeconds, double freeSamples,
 	double positionSeconds, double positionSamples)
 {
 	isPlaying = _isPlaying;
-	globalValues.bps = bps;
+	exactValues.bps = bps;
+
+	exactValues.fs = freeSeconds;
+	exactValues.f = freeSamples;
+	exactValues.ps = positionSeconds;
+	exactValues.p = positionSamples;
+	position = 0;
+
+	updateGlobalValues();
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::startBlock(int startSample, int numSamples)
+{
+	// A voice that starts in the middle of the block skips the samples before, so its time matches the shared values
+	advanceTime(startSample - position, false);
+	position = startSample;
+	blockLength = numSamples;
+
+	for (size_t i = 0; i < plan.programs.size(); ++i)
+		if (plan.programs[i].controlInterval < 0)
+			controlStates[i].countdown = 0;
+
+	updateGlobalValues();
+	updateValues(ByteCodeProcessor::Rate::block);
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::renderSamples(StereoSample* output, int numSamples)
+{
+	for (int i = 0; i < numSamples; ++i)
+	{
+		copySharedSampleValues();
+		processSamplePrograms();
+
+		output[i] = finishSample();
+	}
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::copySharedSampleValues()
+{
+	jassert(!isSharedSequence());
+	const auto& sharedSamplePrograms = plan.sharedSamplePrograms;
+	jassert((size_t)(position + 1) * sharedSamplePrograms.size() <= sharedSequence->sampleValues.size());
+
+	const auto sharedValues = sharedSequence->sampleValues.data() + (size_t)position * sharedSamplePrograms.size();
+
+	for (size_t i = 0; i < sharedSamplePrograms.size(); ++i)
+		values[sharedSamplePrograms[i]] = sharedValues[i];
+}
+
+template <typename Sample>
+StereoSample TypedNodeProcessorSequence<Sample>::finishSample()
+{
+	const StereoSample stereoSample{ plan.left >= 0 ? (float)values[plan.left] : 0.0f, plan.right >= 0 ? (float)values[plan.right] : 0.0f };
+
+	advanceSample();
+
+	return stereoSample;
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::advanceSample()
+{
+	++position;
+	advanceTime(1, true);
+	updateGlobalValues();
+}
+
+template <typename Sample>
+std::unique_ptr<NodeProcessorSequence::LaneBuffers> TypedNodeProcessorSequence<Sample>::createLaneBuffers() const
+{
+	const auto& programs = plan.programs;
+	auto buffers = std::make_unique<TypedLaneBuffers>();
+
+	buffers->values.resize(programs.size() * max_block_size);
+	buffers->globals.resize(9 * max_block_size);
+	buffers->inputs.resize(max_block_size);
+	buffers->scratch.resize(programs.size());
+
+	for (size_t i = 0; i < programs.size(); ++i)
+	{
+		buffers->valueArrays.push_back(buffers->values.data() + i * max_block_size);
+
+		if (programs[i].isLaneable)
+			programs[i].processor->initialiseScratch(buffers->scratch[i]);
+	}
+
+	return buffers;
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::renderLanes(NodeProcessorSequence* const* sequences, int numSequences,
+	StereoSample* const* outputs, int numSamples, LaneBuffers& laneBuffers) const
+{
+	jassert(numSequences <= getNumLanes() && getNumLanes() <= max_voice_lanes);
+
+	// One voice gains nothing from evaluating programs one sample at a time in the block kernels
+	if (numSequences == 1 && !plan.isBlockwise)
+	{
+		sequences[0]->renderSamples(outputs[0], numSamples);
+		return;
+	}
+
+	auto& buffers = static_cast<TypedLaneBuffers&>(laneBuffers);
+	const auto numLanes = (size_t)numSequences;
+
+	TypedNodeProcessorSequence* voices[max_voice_lanes];
+
+	for (int lane = 0; lane < numSequences; ++lane)
+		voices[lane] = static_cast<TypedNodeProcessorSequence*>(sequences[lane]);
+
+	// Without programs that have to run for each voice on its own, as many samples as fit into the block buffers
+	// are evaluated at once, the lanes of every sample one after another
+	const auto isBlockwise = plan.isBlockwise;
+	const auto runLength = isBlockwise ? max_block_size / numSequences : 1;
+
+	// The values that don't change every sample are packed once
+	for (size_t i = 0; i < plan.programs.size(); ++i)
+		for (int lane = 0; lane < numSequences; ++lane)
+			for (auto j = (size_t)lane; j < (size_t)runLength * numLanes; j += numLanes)
+				buffers.values[i * max_block_size + j] = voices[lane]->values[i];
+
+	const auto globals = [&](size_t index) { return buffers.globals.data() + index * max_block_size; };
+	const Sample* inputs[expr_node_num_ins];
+	std::fill(std::begin(inputs), std::end(inputs), buffers.inputs.data());
+
+	const GlobalValueBlock<Sample> block{ globals(0), globals(1), globals(2), globals(3), globals(4), globals(5), globals(6),
+		globals(7), globals(8), globalValues.sr, globalValues.bps, nullptr, buffers.valueArrays.data() };
+
+	for (int start = 0; start < numSamples; start += runLength)
+	{
+		const auto length = juce::jmin(runLength, numSamples - start);
+
+		for (int lane = 0; lane < numSequences; ++lane)
+		{
+			auto& voice = *voices[lane];
 
-	globalValues.fs = freeSeconds;
-	globalValues.f = freeSamples;
-	globalValues.ps = positionSeconds;
-	globalValues.p = positionSamples;
+			for (auto j = (size_t)lane; j < (size_t)length * numLanes; j += numLanes)
+			{
+				voice.copySharedSampleValues();
+
+				for (const auto i : plan.sharedSamplePrograms)
+					buffers.values[(size_t)i * max_block_size + j] = voice.values[i];
+
+				const auto& g = voice.globalValues;
+				const Sample values[] = { g.fs, g.f, g.ps, g.p, g.rs, g.r, g.n, g.t, g.nf };
+
+				for (size_t k = 0; k < 9; ++k)
+					globals(k)[j] = values[k];
+
+				if (isBlockwise)
+					voice.advanceSample();
+			}
+		}
+
+		for (const auto i : samplePrograms)
+		{
+			const auto& program = plan.programs[(size_t)i];
+			const auto laneValues = buffers.values.data() + (size_t)i * max_block_size;
+
+			if (program.isLaneable)
+			{
+				program.processor->processBlock(inputs, block, laneValues, length * numSequences, buffers.scratch[(size_t)i]);
+
+				if (!isBlockwise)
+					for (int lane = 0; lane < numSequences; ++lane)
+						voices[lane]->values[i] = laneValues[lane];
+			}
+			else
+			{
+				for (int lane = 0; lane < numSequences; ++lane)
+				{
+					voices[lane]->processSampleProgram(i);
+					laneValues[lane] = voices[lane]->values[i];
+				}
+			}
+		}
+
+		if (isBlockwise)
+		{
+			const auto leftValues = plan.left >= 0 ? buffers.values.data() + (size_t)plan.left * max_block_size : nullptr;
+			const auto rightValues = plan.right >= 0 ? buffers.values.data() + (size_t)plan.right * max_block_size : nullptr;
+
+			for (int lane = 0; lane < numSequences; ++lane)
+				for (int sample = 0; sample < length; ++sample)
+				{
+					const auto j = (size_t)(sample * numSequences + lane);
+					outputs[lane][start + sample] = { leftValues != nullptr ? (float)leftValues[j] : 0.0f,
+						rightValues != nullptr ? (float)rightValues[j] : 0.0f };
+				}
+		}
+		else
+		{
+			for (int lane = 0; lane < numSequences; ++lane)
+				outputs[lane][start] = voices[lane]->finishSample();
+		}
+	}
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::renderSharedValues(int numSamples)
+{
+	jassert(isSharedSequence());
+
+	const auto numValues = samplePrograms.size();
+
+	// Hosts can send larger blocks than they announced. The voices can't render more than that either.
+	if (numValues > 0)
+		numSamples = juce::jmin(numSamples, (int)(sampleValues.size() / numValues));
+
+	blockLength = numSamples;
+
+	for (size_t i = 0; i < plan.programs.size(); ++i)
+		if (plan.programs[i].controlInterval < 0)
+			controlStates[i].countdown = 0;
+
+	updateValues(ByteCodeProcessor::Rate::block);
+
+	for (int i = 0; i < numSamples; ++i)
+	{
+		processSamplePrograms();
+
+		for (size_t j = 0; j < numValues; ++j)
+			sampleValues[(size_t)i * numValues + j] = values[samplePrograms[j]];
+
+		advanceTime(1, false);
+		updateGlobalValues();
+	}
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::updateValues(ByteCodeProcessor::Rate rate)
+{
+	// Constant values are computed with the note values
+	const auto lowestRate = rate == ByteCodeProcessor::Rate::note ? ByteCodeProcessor::Rate::constant : rate;
+
+	for (size_t i = 0; i < plan.programs.size(); ++i)
+	{
+		const auto& program = plan.programs[i];
+
+		// The shared sequence doesn't compute the values of the voices. Voices copy the shared values,
+		// the ones that change every sample with every sample.
+		if (program.isShared != isSharedSequence())
+		{
+			if (!isSharedSequence() && program.rate != ByteCodeProcessor::Rate::sample)
+				values[i] = sharedSequence->values[i];
+
+			continue;
+		}
+
+		if (program.parameter != nullptr)
+		{
+			if (rate == ByteCodeProcessor::Rate::block)
+				values[i] = program.parameter->get();
+
+			continue;
+		}
+
+		const auto inputValues = getInputValues(program);
+		const auto frame = getFrame(program);
+
+		program.processor->updateCachedValues(rate, inputValues, globalValues, frame);
+
+		if (program.rate >= lowestRate && program.rate <= rate)
+			values[i] = program.processor->process(inputValues, globalValues, frame);
+	}
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::processSamplePrograms()
+{
+	for (const auto i : samplePrograms)
+		processSampleProgram(i);
 }
 
-StereoSample NodeProcessorSequence::getNextStereoSample()
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::processSampleProgram(int index)
 {
-	StereoSample stereoSample{};
+	const auto& program = plan.programs[(size_t)index];
+	auto& value = values[index];
+
+	if (program.controlInterval == 0)
+	{
+		value = program.processor->process(getInputValues(program), globalValues, getFrame(program));
+		return;
+	}
+
+	auto& state = controlStates[(size_t)index];
 
-	for (const auto p : processors)
+	if (state.countdown == 0)
 	{
-		p->processNextValue();
+		const auto newValue = program.processor->process(getInputValues(program), globalValues, getFrame(program));
+		state.countdown = program.controlInterval > 0 ? program.controlInterval : juce::jmax(1, blockLength);
 
-		switch (p->outputType)
+		// Interpolated values ramp to the new value over the next interval, so they lag one interval behind.
+		// Ramps from or to infinity or NaN would never end, those values are taken over directly.
+		if (program.interpolate && !state.restart && std::isfinite(value) && std::isfinite(newValue))
 		{
-		case none: break;
-		case mono:
-			stereoSample.left += p->outValue;
-			stereoSample.right += p->outValue;
-			break;
-		case left:
-			stereoSample.left += p->outValue;
-			break;
-		case right:
-			stereoSample.right += p->outValue;
-			break;
+			state.step = (newValue - value) / (Sample)state.countdown;
 		}
+		else
+		{
+			value = newValue;
+			state.step = 0;
+		}
+
+		state.restart = false;
+	}
+
+	value += state.step;
+	--state.countdown;
+}
+
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::restartControlPrograms()
+{
+	for (auto& state : controlStates)
+	{
+		state.countdown = 0;
+		state.restart = true;
 	}
+}
 
-	globalValues.fs += deltaS;
-	globalValues.f++;
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::advanceTime(int numSamples, bool advanceNoteTime)
+{
+	exactValues.fs += deltaS * numSamples;
+	exactValues.f += numSamples;
 
 	if (isPlaying)
 	{
-		globalValues.ps += deltaS;
-		globalValues.p++;
+		exactValues.ps += deltaS * numSamples;
+		exactValues.p += numSamples;
 	}
 
-	globalValues.rs += deltaS;
-	globalValues.r++;
-	globalValues.n += deltaN;
-	globalValues.t += deltaT;
+	if (advanceNoteTime)
+	{
+		exactValues.rs += deltaS * numSamples;
+		exactValues.r += numSamples;
+		exactValues.n += deltaN * numSamples;
+		exactValues.t += deltaT * numSamples;
+	}
+}
 
-	return stereoSample;
+template <typename Sample>
+void TypedNodeProcessorSequence<Sample>::updateGlobalValues()
+{
+	globalValues.fs = (Sample)exactValues.fs;
+	globalValues.f = (Sample)exactValues.f;
+	globalValues.ps = (Sample)exactValues.ps;
+	globalValues.p = (Sample)exactValues.p;
+	globalValues.rs = (Sample)exactValues.rs;
+	globalValues.r = (Sample)exactValues.r;
+	globalValues.n = (Sample)exactValues.n;
+	globalValues.t = (Sample)exactValues.t;
+
+	globalValues.nf = (Sample)exactValues.nf;
+	globalValues.sr = (Sample)exactValues.sr;
+	globalValues.bps = (Sample)exactValues.bps;
 }
+
+template class TypedNodeProcessorSequence<double>;
+template class TypedNodeProcessorSequence<float>;
@@ -4,92 +4,225 @@
 
 #include "ByteCodeProcessor.h"
 #include "Defines.h"
+#include "RandomGenerator.h"
 
 
-enum OutputType { none, mono, left, right };
-
 struct StereoSample { float left; float right; };
 
-class NodeProcessor
+// What a voice renders the graph with, independent of the sample type.
+// The values that are the same in every voice are computed by one shared sequence for all voices. It renders
+// them for the whole block before the voices render, the sequences of the voices copy them from there.
+class NodeProcessorSequence
 {
 public:
-	virtual void processNextValue() = 0;
+	virtual ~NodeProcessorSequence() = default;
 
-	std::vector<std::vector<NodeProcessor*>> inputs;
+	// The generator for rand starts again from randomSeed, so a note always renders the same way
+	virtual void startNote(double sampleRate, double noteFrequency, juce::uint64 randomSeed) = 0;
 
-	double outValue = 0;
+	virtual void prepareToPlay(double sampleRate, int samplesPerBlock) = 0;
 
-	const OutputType outputType;
+	virtual void sync(bool isPlaying, double bps, double freeSeconds, double freeSamples, double positionSeconds, double positionSamples) = 0;
 
-	virtual ~NodeProcessor() = default;
+	// startSample is the position in the block since the last sync
+	virtual void startBlock(int startSample, int numSamples) = 0;
 
-protected:
-	NodeProcessor(OutputType ot) : outputType(ot) {}
-};
+	// Renders the next numSamples samples of a voice. The sequence is only called once per block, the programs of
+	// every sample are run without virtual calls.
+	virtual void renderSamples(StereoSample* output, int numSamples) = 0;
 
+	// Only for the shared sequence, computes the shared values of the block since the last sync
+	virtual void renderSharedValues(int numSamples) = 0;
 
-class ExpressionNodeProcessor : public NodeProcessor
+	// The buffers renderLanes works in, created by the sequence of a voice of the graph
+	struct LaneBuffers
+	{
+		virtual ~LaneBuffers() = default;
+	};
+
+	// How many voices renderLanes evaluates together, as many as fit into one vector of the block kernels
+	virtual int getNumLanes() const = 0;
+
+	virtual std::unique_ptr<LaneBuffers> createLaneBuffers() const = 0;
+
+	// Renders the next numSamples samples of several voices at once, like renderSamples does for each of them.
+	// Every voice is a lane of the block kernels of the processors, the sequences have to be voices of the graph of
+	// this sequence. Programs that draw random numbers or run at control rate are evaluated for each voice on its own,
+	// because every voice has its own generator and countdown. Without them, runs of samples are evaluated at once:
+	// every program runs over the whole run before the next one, which keeps its code hot and its loops vectorised.
+	// A single sequence with such programs renders sample by sample, like renderSamples.
+	virtual void renderLanes(NodeProcessorSequence* const* sequences, int numSequences, StereoSample* const* outputs,
+		int numSamples, LaneBuffers& buffers) const = 0;
+};
+
+// Renders the programs of a FusedGraph with the sample type the graph is evaluated with, double or float
+template <typename Sample>
+class TypedNodeProcessorSequence : public NodeProcessorSequence
 {
 public:
-	ExpressionNodeProcessor(ByteCodeProcessor& p, GlobalValues& gv)
-		: NodeProcessor(none), globalValues(gv), processor(p)
+	// The programs of a graph, which of them run every sample and where their state lives in the arena of a sequence.
+	// It is built once per graph and doesn't change after that. The shared sequence owns it, the voices read it.
+	class Plan
 	{
-	}
+	public:
+		Plan(int leftValue, int rightValue);
 
-	void processNextValue() override;
+		// The values have to be added in the order of the FusedGraph. Parameters are always shared.
+		// Programs that run every sample can run at control rate instead, see FusedGraph::Value.
+		void addProgram(const ByteCodeProcessor& processor, bool shared, int controlInterval, bool interpolate);
+		void addParameter(juce::AudioParameterFloat& parameter);
 
-private:
+	private:
+		friend class TypedNodeProcessorSequence;
 
-	double inputValues[expr_node_num_ins]{ 0 };
-	GlobalValues& globalValues;
+		struct Program
+		{
+			const ByteCodeProcessor* processor;
+			juce::AudioParameterFloat* parameter;
+			ByteCodeProcessor::Rate rate;
+			bool isShared;
+			int controlInterval;
+			bool interpolate;
 
-	ByteCodeProcessor& processor;
-};
+			// The program can be evaluated for several voices at once, see renderLanes
+			bool isLaneable;
 
+			// Where the input values and the frame of the program start in the arena. The programs have no inputs,
+			// only the hoisted subexpressions after them are used.
+			int inputOffset;
+			int frameOffset;
+		};
 
-class OutputNodeProcessor : public NodeProcessor
-{
-public:
-	OutputNodeProcessor(OutputType outputType) : NodeProcessor(outputType)
-	{
-	}
+		std::vector<Program> programs;
 
-	void processNextValue() override;
-};
+		// The indices of the shared and the voice programs that have to run every sample. The voices copy the shared
+		// values that change every sample with every sample.
+		std::vector<int> sharedSamplePrograms;
+		std::vector<int> voiceSamplePrograms;
 
+		// The values of the output channels, -1 for silence
+		const int left;
+		const int right;
 
-class ParameterNodeProcessor : public NodeProcessor
-{
-public:
+		// What an arena starts with: the input values and the initialised frames of the programs
+		std::vector<Sample> initialState;
 
-	ParameterNodeProcessor(juce::AudioParameterFloat& param) : NodeProcessor(none), parameter(param)
-	{
-	}
+		// Every voice sample program is laneable, so the lanes of several samples can be evaluated at once
+		bool isBlockwise = true;
+	};
 
-	void processNextValue() override;
+	// The shared sequence of the voices, which only computes the shared values
+	explicit TypedNodeProcessorSequence(std::unique_ptr<const Plan> plan);
 
-private:
-	juce::AudioParameterFloat& parameter;
-};
+	// The sequence of a voice, with the plan of the shared sequence
+	explicit TypedNodeProcessorSequence(const TypedNodeProcessorSequence* sharedSequence);
 
-class NodeProcessorSequence
-{
-public:
-	void startNote(double sampleRate, double noteFrequency);
+	void startNote(double sampleRate, double noteFrequency, juce::uint64 randomSeed) override;
+
+	void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+
+	void sync(bool _isPlaying, double bps, double freeSeconds, double freeSamples, double positionSeconds, double positionSamples) override;
 
-	void prepareToPlay(double sampleRate);
+	void startBlock(int startSample, int numSamples) override;
 
-	void sync(bool _isPlaying, double bps, double freeSeconds, double freeSamples, double positionSeconds, double positionSamples);
+	void renderSamples(StereoSample* output, int numSamples) override;
 
-	StereoSample getNextStereoSample();
+	void renderSharedValues(int numSamples) override;
 
-	juce::OwnedArray<NodeProcessor> processors;
-	GlobalValues globalValues;
+	// One vector of AVX2
+	int getNumLanes() const override { return std::is_same<Sample, float>::value ? 8 : 4; }
+
+	std::unique_ptr<LaneBuffers> createLaneBuffers() const override;
+
+	void renderLanes(NodeProcessorSequence* const* sequences, int numSequences, StereoSample* const* outputs,
+		int numSamples, LaneBuffers& buffers) const override;
 
 private:
-	bool isPlaying;
+	// The state of a program at control rate
+	struct ControlState
+	{
+		// The samples until the program is evaluated again, and how much its value changes every sample
+		int countdown = 0;
+		Sample step = 0;
+
+		// The next value isn't interpolated, because the last one belongs to another note
+		bool restart = true;
+	};
+
+	struct TypedLaneBuffers : LaneBuffers
+	{
+		// One block of lanes per value, and per global value that changes every sample
+		std::vector<Sample> values;
+		std::vector<const Sample*> valueArrays;
+		std::vector<Sample> globals;
+
+		// Fused programs have no inputs, they read zeros
+		std::vector<Sample> inputs;
+
+		// The block buffers for every program
+		std::vector<ByteCodeProcessor::Scratch<Sample>> scratch;
+	};
+
+	bool isSharedSequence() const noexcept { return sharedSequence == nullptr; }
+
+	Sample* getInputValues(const typename Plan::Program& program) noexcept { return arena.data() + program.inputOffset; }
+	Sample* getFrame(const typename Plan::Program& program) noexcept { return arena.data() + program.frameOffset; }
+
+	// The steps of rendering a sample, before and after the sample programs
+	void copySharedSampleValues();
+	StereoSample finishSample();
+
+	// finishSample without the output
+	void advanceSample();
+
+	// Updates the cached values of a rate and computes the values that only change at that rate
+	void updateValues(ByteCodeProcessor::Rate rate);
+
+	void processSamplePrograms();
+	void processSampleProgram(int index);
+
+	// Evaluates the programs at control rate again at the next sample, without interpolating
+	void restartControlPrograms();
+
+	// Advances the time by a number of samples. The note time only advances while the voice renders.
+	void advanceTime(int numSamples, bool advanceNoteTime);
+
+	// Copies exactValues into the global values the expressions read
+	void updateGlobalValues();
+
+	// Only set in the shared sequence
+	const std::unique_ptr<const Plan> ownedPlan;
+
+	const Plan& plan;
+	const TypedNodeProcessorSequence* const sharedSequence;
+
+	// The programs of the plan that run every sample in this sequence
+	const std::vector<int>& samplePrograms;
+
+	// Everything the programs change while they run, in one allocation: the input values and frames, then the values
+	std::vector<Sample> arena;
+	Sample* const values;
+
+	std::vector<ControlState> controlStates;
+
+	// The shared sequence keeps the values of its sample programs for the whole block, one sample after the other
+	std::vector<Sample> sampleValues;
+
+	// The position in the block since the last sync
+	int position = 0;
+
+	// The length of the current block, for programs that are evaluated once per block
+	int blockLength = 0;
+
+	GlobalValues<Sample> globalValues{};
+	RandomGenerator random;
+
+	// The global values are kept in doubles, so the time keeps advancing when floats can no longer represent its steps
+	GlobalValues<double> exactValues{};
+
+	bool isPlaying = false;
 
-	double deltaS;
-	double deltaT;
-	double deltaN;
+	double deltaS = 0;
+	double deltaT = 0;
+	double deltaN = 0;
 };
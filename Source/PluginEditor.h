@@ -95,6 +95,24 @@ public:
 			}
 		};
 
+		addAndMakeVisible(parallelVoicesButton);
+		parallelVoicesButton.setButtonText("Parallel voices");
+		parallelVoicesButton.setToggleState(audioProcessor.isRenderingVoicesInParallel(), juce::dontSendNotification);
+
+		parallelVoicesButton.onClick = [this]()
+		{
+			audioProcessor.setParallelVoices(parallelVoicesButton.getToggleState());
+		};
+
+		addAndMakeVisible(voiceLanesButton);
+		voiceLanesButton.setButtonText("Voice lanes");
+		voiceLanesButton.setToggleState(audioProcessor.isRenderingVoiceLanes(), juce::dontSendNotification);
+
+		voiceLanesButton.onClick = [this]()
+		{
+			audioProcessor.setVoiceLanes(voiceLanesButton.getToggleState());
+		};
+
 		bpmLabel.onTextChange = [this]()
 		{
 			auto value = bpmLabel.getText().getFloatValue();
@@ -165,6 +183,10 @@ public:
 		bpmLabel.setBounds(bpmLabel.getBounds().reduced(0, 20));
 		bpmLabel.setEditable(true);
 
+		bounds.removeFromLeft(25);
+		parallelVoicesButton.setBounds(bounds.removeFromLeft(130));
+		voiceLanesButton.setBounds(bounds.removeFromLeft(110));
+
 		bounds.removeFromLeft(50);
 		adsrLabel.setBounds(bounds.removeFromLeft(50));
 
@@ -187,6 +209,8 @@ public:
 private:
 
 	juce::ToggleButton syncToHostButton;
+	juce::ToggleButton parallelVoicesButton;
+	juce::ToggleButton voiceLanesButton;
 	juce::Label bpmLabel;
 
 	juce::Slider attackSlider;
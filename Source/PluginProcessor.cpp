@@ -3,6 +3,7 @@
 #include "CustomRange.h"
 #include "GraphRenderSequence.h"
 #include "PluginEditor.h"
+#include "Resampler.h"
 #include "SynthVoice.h"
 
 ByteBeatNodeGraphAudioProcessor::ByteBeatNodeGraphAudioProcessor()
@@ -30,6 +31,12 @@ void ByteBeatNodeGraphAudioProcessor::prepareToPlay(double sampleRate, int sampl
 	synth.setCurrentPlaybackSampleRate(sampleRate);
 	synth.setNoteStealingEnabled(false);
 
+	if (const auto state = renderStates.acquire())
+		installRenderState(*state);
+
+	if (const auto state = renderStates.getCurrent())
+		state->prepare(sampleRate, samplesPerBlock);
+
 	for (int i = 0; i < synth.getNumVoices(); ++i)
 	{
 		if (const auto voice = dynamic_cast<SynthVoice*>(synth.getVoice(i)))
@@ -65,6 +72,9 @@ void ByteBeatNodeGraphAudioProcessor::processBlock(juce::AudioBuffer<float>& buf
 	for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
 		buffer.clear(i, 0, buffer.getNumSamples());
 
+	// A graph that changed since the last block takes over here
+	if (const auto state = renderStates.acquire(getSampleRate(), getBlockSize()))
+		installRenderState(*state);
 
 	const auto playHead = getPlayHead();
 	double positionSeconds = 0;
@@ -106,10 +116,23 @@ void ByteBeatNodeGraphAudioProcessor::processBlock(juce::AudioBuffer<float>& buf
 	{
 		if (const auto voice = dynamic_cast<SynthVoice*>(synth.getVoice(i)))
 		{
-			voice->update(adsrParameters, positionInfo.isPlaying, bps, freeSeconds, freeSamples, positionSeconds, positionSamples);
+			voice->update(adsrParameters, positionInfo.isPlaying, bps, freeSeconds, freeSamples, positionSeconds, positionSamples, randomSeed.get());
 		}
 	}
 	
+	if (const auto state = renderStates.getCurrent())
+	{
+		// Below the host rate, the shared values are rendered for the samples the voices render in this block
+		const auto hostRate = getSampleRate();
+		const auto renderRate = Resampler::getRenderRate(state->graphSequence->getRenderRate(), hostRate);
+		const auto first = Resampler::getRenderedSample(freeSamples - 1, renderRate, hostRate) + 1;
+		const auto end = Resampler::getRenderedSample(freeSamples + buffer.getNumSamples() - 1, renderRate, hostRate) + 1;
+		const auto renderedPosition = Resampler::getRenderedSample(positionSamples - 1, renderRate, hostRate) + 1;
+
+		state->sharedSequence->sync(positionInfo.isPlaying, bps, freeSeconds, (double)first, positionSeconds, (double)renderedPosition);
+		state->sharedSequence->renderSharedValues((int)(end - first));
+	}
+
 	freeSeconds += buffer.getNumSamples() / getSampleRate();
 	freeSamples += buffer.getNumSamples();
 	
@@ -137,6 +160,9 @@ void ByteBeatNodeGraphAudioProcessor::getStateInformation(juce::MemoryBlock& des
 	pluginState.addChild(graph.toValueTree(), -1, nullptr);
 	pluginState.setProperty("sync", syncToHost.get(), nullptr);
 	pluginState.setProperty("bpm", beatsPerMinute.get(), nullptr);
+	pluginState.setProperty("seed", randomSeed.get(), nullptr);
+	pluginState.setProperty("parallelVoices", isRenderingVoicesInParallel(), nullptr);
+	pluginState.setProperty("voiceLanes", isRenderingVoiceLanes(), nullptr);
 
 	pluginState.writeToStream(mos);
 }
@@ -148,24 +174,52 @@ void ByteBeatNodeGraphAudioProcessor::setStateInformation(const void* data, int
 	{
 		syncToHost.set(tree.getProperty("sync"));
 		beatsPerMinute.set(tree.getProperty("bpm"));
+		randomSeed.set(tree.getProperty("seed", 0));
+		setParallelVoices(tree.getProperty("parallelVoices", false));
+		setVoiceLanes(tree.getProperty("voiceLanes", false));
 		apvts.replaceState(tree.getChildWithName("apvts"));
 		graph.restoreFromTree(tree.getChildWithName("graph"));
 	}
 }
 
-void ByteBeatNodeGraphAudioProcessor::setNodeProcessorSequence(GraphRenderSequence& sequence)
+void ByteBeatNodeGraphAudioProcessor::setNodeProcessorSequence(std::unique_ptr<GraphRenderSequence> sequence)
 {
-	const juce::ScopedLock sl(getCallbackLock());
+	renderStates.publish(std::make_unique<RenderState>(std::move(sequence), apvts, synth.getNumVoices(), getSampleRate(), getBlockSize()));
+}
 
+void ByteBeatNodeGraphAudioProcessor::installRenderState(RenderState& state)
+{
 	for (int i = 0; i < synth.getNumVoices(); ++i)
 	{
-		const auto nodeProcessorSequence = sequence.createNodeProcessorSequence(apvts);
-
 		if (const auto voice = dynamic_cast<SynthVoice*>(synth.getVoice(i)))
 		{
-			voice->setProcessorSequence(nodeProcessorSequence);
+			voice->setProcessorSequence(state.voiceSequences[(size_t)i].get(), state.graphSequence->getRenderRate());
 		}
 	}
+
+	synth.setLaneBuffers(state.laneBuffers.getRawDataPointer(), state.numLanes);
+}
+
+void ByteBeatNodeGraphAudioProcessor::setParallelVoices(bool shouldRenderInParallel)
+{
+	if (shouldRenderInParallel == synth.isRenderingInParallel()) return;
+
+	auto pool = shouldRenderInParallel ? synth.createThreadPool() : nullptr;
+
+	{
+		const juce::ScopedLock sl(getCallbackLock());
+		pool = synth.setThreadPool(std::move(pool));
+	}
+
+	// The old pool stops its threads here, the audio thread no longer uses it
+	pool.reset();
+}
+
+void ByteBeatNodeGraphAudioProcessor::setVoiceLanes(bool shouldRenderInLanes)
+{
+	const juce::ScopedLock sl(getCallbackLock());
+
+	synth.setVoiceLanes(shouldRenderInLanes);
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout ByteBeatNodeGraphAudioProcessor::createParameters() const
@@ -3,7 +3,10 @@
 #include <JuceHeader.h>
 
 #include "InternalNodeGraph.h"
+#include "NodeProcessor.h"
 #include "ParameterManager.h"
+#include "RenderState.h"
+#include "SynthVoice.h"
 
 class ByteBeatNodeGraphAudioProcessor  : public juce::AudioProcessor , public juce::ChangeBroadcaster
 {
@@ -43,11 +46,24 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     
-    void setNodeProcessorSequence(GraphRenderSequence& sequence);
+    // Builds the sequences of the voices for a compiled graph and hands them to the audio thread, which takes them
+    // over at the start of its next block. Only for the message thread, it never blocks the audio callback.
+    void setNodeProcessorSequence(std::unique_ptr<GraphRenderSequence> sequence);
+
+    // Renders the active voices in parallel on worker threads, see VoiceSynthesiser
+    void setParallelVoices(bool shouldRenderInParallel);
+    bool isRenderingVoicesInParallel() const { return synth.isRenderingInParallel(); }
+
+    // Renders groups of voices together in the lanes of the block kernels, see VoiceSynthesiser
+    void setVoiceLanes(bool shouldRenderInLanes);
+    bool isRenderingVoiceLanes() const { return synth.isRenderingInLanes(); }
     
     juce::Atomic<double> beatsPerMinute{0};
     juce::Atomic<bool> syncToHost{false};
     
+    // The seed for the rand op, saved with the state so renders are reproducible
+    juce::Atomic<int> randomSeed{0};
+    
     juce::AudioProcessorValueTreeState apvts;
 
 private:
@@ -56,7 +72,14 @@ public:
     InternalNodeGraph graph;
 private:
 
-    juce::Synthesiser synth;
+    VoiceSynthesiser synth;
+
+    // The sequences the voices render with. The shared sequence of the current state computes the values of the
+    // graph that are the same in every voice, before the voices render.
+    RenderStateExchange renderStates;
+
+    // Points the voices at the sequences of a state the audio thread just took over
+    void installRenderState(RenderState& state);
     
     juce::AudioProcessorValueTreeState::ParameterLayout createParameters() const;
 
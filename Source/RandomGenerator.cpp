@@ -0,0 +1,120 @@
+#include "RandomGenerator.h"
+
+#include "Defines.h"
+
+// The upper 52 bits become the mantissa of a double in [1, 2)
+static constexpr juce::uint64 oneBits = 0x3FF0000000000000;
+
+static double toUnitInterval(juce::uint64 x)
+{
+	const auto bits = (x >> 12) | oneBits;
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value - 1.0;
+}
+
+static juce::uint64 rotateLeft(juce::uint64 x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+#if BBGRAPH_AVX2
+BBGRAPH_AVX2_TARGET static void stepVector(juce::uint64 (*state)[4], double* destination)
+{
+	auto s0 = _mm256_load_si256((const __m256i*)state[0]);
+	auto s1 = _mm256_load_si256((const __m256i*)state[1]);
+	auto s2 = _mm256_load_si256((const __m256i*)state[2]);
+	auto s3 = _mm256_load_si256((const __m256i*)state[3]);
+
+	const auto result = _mm256_add_epi64(s0, s3);
+	const auto t = _mm256_slli_epi64(s1, 17);
+
+	s2 = _mm256_xor_si256(s2, s0);
+	s3 = _mm256_xor_si256(s3, s1);
+	s1 = _mm256_xor_si256(s1, s2);
+	s0 = _mm256_xor_si256(s0, s3);
+	s2 = _mm256_xor_si256(s2, t);
+	s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+
+	_mm256_store_si256((__m256i*)state[0], s0);
+	_mm256_store_si256((__m256i*)state[1], s1);
+	_mm256_store_si256((__m256i*)state[2], s2);
+	_mm256_store_si256((__m256i*)state[3], s3);
+
+	const auto bits = _mm256_or_si256(_mm256_srli_epi64(result, 12), _mm256_set1_epi64x((long long)oneBits));
+	_mm256_storeu_pd(destination, _mm256_sub_pd(_mm256_castsi256_pd(bits), _mm256_set1_pd(1.0)));
+}
+#endif
+
+void RandomGenerator::seed(juce::uint64 seed)
+{
+	// splitmix64, as recommended for seeding xoshiro
+	for (auto& word : state)
+	{
+		for (auto& streamWord : word)
+		{
+			seed += 0x9E3779B97F4A7C15;
+			auto z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+			streamWord = z ^ (z >> 31);
+		}
+	}
+
+	nextValue = numStreams;
+}
+
+void RandomGenerator::fill(double* destination, int numValues)
+{
+	int i = 0;
+
+	for (; i < numValues && nextValue < numStreams; ++i)
+		destination[i] = values[nextValue++];
+
+#if BBGRAPH_AVX2
+	if (hasAVX2())
+	{
+		for (; i + numStreams <= numValues; i += numStreams)
+			stepVector(state, destination + i);
+	}
+#endif
+
+	for (; i + numStreams <= numValues; i += numStreams)
+		step(destination + i);
+
+	for (; i < numValues; ++i)
+		destination[i] = next();
+}
+
+void RandomGenerator::fill(float* destination, int numValues)
+{
+	// Whole steps are filled as doubles, so the values are the ones next<float> gives
+	double buffer[64];
+
+	for (int i = 0; i < numValues; i += (int)std::size(buffer))
+	{
+		const auto count = juce::jmin((int)std::size(buffer), numValues - i);
+		fill(buffer, count);
+
+		for (int j = 0; j < count; ++j)
+			destination[i + j] = toSample<float>(buffer[j]);
+	}
+}
+
+void RandomGenerator::step(double* destination)
+{
+	for (int j = 0; j < numStreams; ++j)
+	{
+		const auto result = state[0][j] + state[3][j];
+		const auto t = state[1][j] << 17;
+
+		state[2][j] ^= state[0][j];
+		state[3][j] ^= state[1][j];
+		state[1][j] ^= state[2][j];
+		state[0][j] ^= state[3][j];
+		state[2][j] ^= t;
+		state[3][j] = rotateLeft(state[3][j], 45);
+
+		destination[j] = toUnitInterval(result);
+	}
+}
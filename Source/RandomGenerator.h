@@ -0,0 +1,48 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// The generator behind the rand op. Every voice has its own one, which is seeded again for each note,
+// so renders are reproducible and voices never share state.
+// It runs four interleaved xoshiro256+ streams. next hands out the values of one step of all streams in turn,
+// fill computes whole steps at once with AVX2 where available. Both give the same sequence.
+class RandomGenerator
+{
+public:
+	RandomGenerator() { seed(0); }
+
+	void seed(juce::uint64 seed);
+
+	// A value in [0, 1)
+	template <typename Sample = double>
+	Sample next()
+	{
+		if (nextValue == numStreams)
+		{
+			step(values);
+			nextValue = 0;
+		}
+
+		return toSample<Sample>(values[nextValue++]);
+	}
+
+	void fill(double* destination, int numValues);
+	void fill(float* destination, int numValues);
+
+private:
+	static constexpr int numStreams = 4;
+
+	void step(double* destination);
+
+	template <typename Sample>
+	static Sample toSample(double x) { return x; }
+
+	// state[i][j] is word i of stream j, so a step of all streams works on whole rows
+	alignas(32) juce::uint64 state[4][numStreams];
+	double values[numStreams];
+	int nextValue = numStreams;
+};
+
+// Rounding to the nearest float could give 1, so floats keep the upper 24 bits of the value instead
+template <>
+inline float RandomGenerator::toSample<float>(double x) { return (float)(int)(x * 0x1p24) * 0x1p-24f; }
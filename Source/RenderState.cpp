@@ -0,0 +1,123 @@
+#include "RenderState.h"
+
+#include "Resampler.h"
+
+RenderState::RenderState(std::unique_ptr<GraphRenderSequence> sequence, juce::AudioProcessorValueTreeState& apvts, int numVoices,
+	double newHostRate, int newBlockSize)
+	: graphSequence(std::move(sequence))
+{
+	sharedSequence.reset(graphSequence->createSharedSequence(apvts));
+
+	for (int i = 0; i < numVoices; ++i)
+		voiceSequences.emplace_back(graphSequence->createNodeProcessorSequence(apvts, *sharedSequence));
+
+	if (!voiceSequences.empty())
+	{
+		const auto& voiceSequence = *voiceSequences.front();
+		numLanes = voiceSequence.getNumLanes();
+
+		for (int i = 0; i < (numVoices + numLanes - 1) / numLanes; ++i)
+			laneBuffers.add(voiceSequence.createLaneBuffers().release());
+	}
+
+	prepare(newHostRate, newBlockSize);
+}
+
+void RenderState::prepare(double newHostRate, int newBlockSize)
+{
+	hostRate = newHostRate;
+	blockSize = newBlockSize;
+
+	const auto renderRate = Resampler::getRenderRate(graphSequence->getRenderRate(), hostRate);
+
+	// The voices copy values from the shared sequence when they prepare
+	sharedSequence->prepareToPlay(renderRate, blockSize);
+
+	for (auto& sequence : voiceSequences)
+		sequence->prepareToPlay(renderRate, blockSize);
+}
+
+RenderStateExchange::~RenderStateExchange()
+{
+	stopTimer();
+
+	free(retired.exchange(nullptr));
+	delete unprepared.exchange(nullptr);
+	delete pending.exchange(nullptr);
+	delete current;
+}
+
+void RenderStateExchange::publish(std::unique_ptr<RenderState> state)
+{
+	delete pending.exchange(state.release());
+
+	if (!isTimerRunning())
+		startTimer(500);
+}
+
+RenderState* RenderStateExchange::acquire() noexcept
+{
+	const auto next = pending.exchange(nullptr);
+	return next != nullptr ? makeCurrent(next) : nullptr;
+}
+
+RenderState* RenderStateExchange::acquire(double hostRate, int blockSize) noexcept
+{
+	const auto next = pending.exchange(nullptr);
+	if (next == nullptr) return nullptr;
+
+	// The host prepared for another rate or block size while the state was built
+	if (next->hostRate != hostRate || next->blockSize != blockSize)
+	{
+		next->requiredHostRate = hostRate;
+		next->requiredBlockSize = blockSize;
+
+		if (const auto replaced = unprepared.exchange(next))
+			retire(replaced);
+
+		return nullptr;
+	}
+
+	return makeCurrent(next);
+}
+
+RenderState* RenderStateExchange::makeCurrent(RenderState* state) noexcept
+{
+	if (current != nullptr)
+		retire(current);
+
+	current = state;
+	return current;
+}
+
+void RenderStateExchange::retire(RenderState* state) noexcept
+{
+	state->nextRetired = retired.load();
+	while (!retired.compare_exchange_weak(state->nextRetired, state)) {}
+}
+
+void RenderStateExchange::timerCallback()
+{
+	free(retired.exchange(nullptr));
+
+	if (const auto state = unprepared.exchange(nullptr))
+	{
+		state->prepare(state->requiredHostRate, state->requiredBlockSize);
+
+		// A state that was published in the meantime is newer
+		RenderState* expected = nullptr;
+
+		if (!pending.compare_exchange_strong(expected, state))
+			delete state;
+	}
+}
+
+void RenderStateExchange::free(RenderState* state)
+{
+	while (state != nullptr)
+	{
+		const auto next = state->nextRetired;
+		delete state;
+		state = next;
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "GraphRenderSequence.h"
+#include "NodeProcessor.h"
+
+// Everything the voices render a graph with: the compiled graph, the shared sequence, a sequence for every voice and
+// the buffers for rendering the voices in lanes. It is built and prepared on the message thread and handed to the
+// audio thread as a whole, which only has to point the voices at it.
+struct RenderState
+{
+	RenderState(std::unique_ptr<GraphRenderSequence> sequence, juce::AudioProcessorValueTreeState& apvts, int numVoices,
+		double hostRate, int blockSize);
+
+	// Prepares the sequences for another host rate or block size
+	void prepare(double newHostRate, int newBlockSize);
+
+	// Owns the programs the sequences run
+	const std::unique_ptr<GraphRenderSequence> graphSequence;
+
+	std::unique_ptr<NodeProcessorSequence> sharedSequence;
+	std::vector<std::unique_ptr<NodeProcessorSequence>> voiceSequences;
+
+	// One for every group of numLanes voices, see VoiceSynthesiser::setLaneBuffers
+	juce::OwnedArray<NodeProcessorSequence::LaneBuffers> laneBuffers;
+	int numLanes = 1;
+
+	// What the sequences are prepared for
+	double hostRate = 0;
+	int blockSize = 0;
+
+	// What the audio thread needed when it turned the state down, see RenderStateExchange::acquire
+	double requiredHostRate = 0;
+	int requiredBlockSize = 0;
+
+	// Links the states that wait to be freed
+	RenderState* nextRetired = nullptr;
+};
+
+// Hands RenderStates from the message thread to the audio thread without locks. The message thread publishes a new
+// state, the audio thread picks it up at the start of a block and retires the one it replaces. Retired states are
+// freed by a timer on the message thread, so the audio thread never waits, allocates or frees. States that are
+// prepared for another host rate or block size than the audio thread needs are prepared again by the timer too.
+class RenderStateExchange : private juce::Timer
+{
+public:
+	RenderStateExchange() = default;
+	~RenderStateExchange() override;
+
+	// Message thread. A state that was published but not picked up yet is replaced, it was never used.
+	void publish(std::unique_ptr<RenderState> state);
+
+	// Makes the last published state current and returns it, nullptr if there is none since the last call.
+	// Only for the audio thread, or while it doesn't run, like in prepareToPlay.
+	RenderState* acquire() noexcept;
+
+	// Audio thread. Like acquire, but a state that isn't prepared for the host rate and block size is handed back to
+	// the message thread, which prepares and publishes it again. The current state stays until then.
+	RenderState* acquire(double hostRate, int blockSize) noexcept;
+
+	// The state the audio thread renders with, only for the audio thread
+	RenderState* getCurrent() const noexcept { return current; }
+
+private:
+	void timerCallback() override;
+
+	RenderState* makeCurrent(RenderState* state) noexcept;
+	void retire(RenderState* state) noexcept;
+
+	// Frees a list of retired states
+	static void free(RenderState* state);
+
+	std::atomic<RenderState*> pending{ nullptr };
+
+	// The last state the audio thread turned down, it waits to be prepared again
+	std::atomic<RenderState*> unprepared{ nullptr };
+
+	// A stack of the retired states. Only the audio thread pushes, the timer takes the whole stack at once.
+	std::atomic<RenderState*> retired{ nullptr };
+
+	RenderState* current = nullptr;
+
+	JUCE_DECLARE_NON_COPYABLE(RenderStateExchange)
+};
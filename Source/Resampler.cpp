@@ -0,0 +1,130 @@
+#include "Resampler.h"
+
+#if JUCE_INTEL
+#include <immintrin.h>
+#endif
+
+const std::array<std::array<float, Resampler::numTaps>, Resampler::numPhases + 1> Resampler::coefficients = []
+{
+	constexpr double cutoff = 0.9;
+	constexpr double beta = 8.0;
+
+	// The modified Bessel function of the first kind of order 0, for the Kaiser window
+	const auto bessel = [](double x)
+	{
+		double sum = 1.0;
+		double term = 1.0;
+
+		for (int k = 1; k < 32; ++k)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+
+		return sum;
+	};
+
+	std::array<std::array<float, numTaps>, numPhases + 1> table;
+
+	for (int p = 0; p <= numPhases; ++p)
+	{
+		double row[numTaps];
+		double sum = 0.0;
+
+		for (int k = 0; k < numTaps; ++k)
+		{
+			// The distance of the output from the sample, in rendered samples
+			const auto t = (double)p / numPhases + numTaps / 2 - 1 - k;
+			const auto x = juce::MathConstants<double>::pi * cutoff * t;
+			const auto sinc = t == 0.0 ? 1.0 : std::sin(x) / x;
+			const auto w = t / (numTaps / 2);
+			const auto window = std::abs(w) < 1.0 ? bessel(beta * std::sqrt(1.0 - w * w)) / bessel(beta) : 0.0;
+
+			row[k] = sinc * window;
+			sum += row[k];
+		}
+
+		// Every row passes constant signals unchanged
+		for (int k = 0; k < numTaps; ++k)
+			table[p][k] = (float)(row[k] / sum);
+	}
+
+	return table;
+}();
+
+double Resampler::getRenderRate(double graphRate, double hostRate)
+{
+	return graphRate > 0 && graphRate < hostRate ? graphRate : hostRate;
+}
+
+juce::int64 Resampler::getRenderedSample(double hostSample, double renderRate, double hostRate)
+{
+	// At the host rate every host sample is rendered
+	if (renderRate == hostRate)
+		return (juce::int64)std::floor(hostSample);
+
+	return (juce::int64)std::floor(hostSample * renderRate / hostRate);
+}
+
+void Resampler::prepare(double newRenderRate, double newHostRate)
+{
+	renderRate = newRenderRate;
+	hostRate = newHostRate;
+	reset();
+}
+
+void Resampler::reset()
+{
+	left.fill(0.0f);
+	right.fill(0.0f);
+	writePosition = 0;
+}
+
+void Resampler::push(StereoSample sample)
+{
+	left[(size_t)writePosition] = left[(size_t)(writePosition + numTaps)] = sample.left;
+	right[(size_t)writePosition] = right[(size_t)(writePosition + numTaps)] = sample.right;
+
+	writePosition = (writePosition + 1) % numTaps;
+}
+
+StereoSample Resampler::process(double hostSample) const
+{
+	const auto position = hostSample * renderRate / hostRate;
+	const auto fraction = (position - std::floor(position)) * numPhases;
+	const auto phase = juce::jlimit(0, numPhases - 1, (int)fraction);
+	const auto blend = (float)(fraction - phase);
+
+	// After the last push, writePosition is the oldest sample
+	const auto l = left.data() + writePosition;
+	const auto r = right.data() + writePosition;
+	const auto a = coefficients[(size_t)phase].data();
+	const auto b = coefficients[(size_t)phase + 1].data();
+
+	const auto la = dotProduct(a, l);
+	const auto ra = dotProduct(a, r);
+
+	return { la + blend * (dotProduct(b, l) - la), ra + blend * (dotProduct(b, r) - ra) };
+}
+
+float Resampler::dotProduct(const float* x, const float* y)
+{
+#if JUCE_INTEL
+	auto sum = _mm_mul_ps(_mm_loadu_ps(x), _mm_loadu_ps(y));
+
+	for (int i = 4; i < numTaps; i += 4)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+	return _mm_cvtss_f32(sum);
+#else
+	float sum = 0.0f;
+
+	for (int i = 0; i < numTaps; ++i)
+		sum += x[i] * y[i];
+
+	return sum;
+#endif
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "NodeProcessor.h"
+
+// Converts the output of a graph that renders at a lower rate than the host to the host rate.
+// Each output sample is interpolated from the last numTaps rendered samples by a Kaiser windowed sinc filter with
+// its cutoff at 0.45 times the render rate. The coefficients are tabulated for numPhases positions between two
+// rendered samples and interpolated linearly in between. The output is delayed by numTaps / 2 rendered samples,
+// so the filter never needs samples that haven't been rendered yet.
+// Rendered samples lie on a grid that starts at host sample 0, so the voices and the shared values of a graph
+// render the same samples, no matter when a voice starts.
+class Resampler
+{
+public:
+	// The rate a graph is rendered at. 0 and rates at or above the host rate render at the host rate.
+	static double getRenderRate(double graphRate, double hostRate);
+
+	// The index of the last sample rendered at or before a host sample
+	static juce::int64 getRenderedSample(double hostSample, double renderRate, double hostRate);
+
+	void prepare(double renderRate, double hostRate);
+
+	// At the host rate the output is rendered directly
+	bool isBypassed() const noexcept { return renderRate == hostRate; }
+
+	// Forgets the rendered samples, for a new note
+	void reset();
+
+	void push(StereoSample sample);
+
+	// The output at a host sample. The samples up to getRenderedSample(hostSample) have to be pushed.
+	StereoSample process(double hostSample) const;
+
+private:
+	static constexpr int numTaps = 16;
+	static constexpr int numPhases = 64;
+
+	// Row p holds the coefficients for the position p / numPhases after the last rendered sample, oldest sample first
+	static const std::array<std::array<float, numTaps>, numPhases + 1> coefficients;
+
+	static float dotProduct(const float* x, const float* y);
+
+	double renderRate = 0;
+	double hostRate = 0;
+
+	// Every sample is written twice, numTaps apart, so the last numTaps samples are always contiguous
+	std::array<float, numTaps * 2> left{};
+	std::array<float, numTaps * 2> right{};
+	int writePosition = 0;
+};
@@ -10,7 +10,11 @@ void SynthVoice::startNote(int midiNoteNumber, float velocity, juce::Synthesiser
 {
 	if (processorSequence == nullptr) return;
 
-	processorSequence->startNote(getSampleRate(), juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber));
+	// Each note number gets its own sequence of random values
+	const auto noteSeed = ((juce::uint64)(juce::uint32)randomSeed << 7) | (juce::uint64)midiNoteNumber;
+
+	processorSequence->startNote(getRenderRate(), juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber), noteSeed);
+	isNewNote = true;
 	adsr.noteOn();
 }
 
@@ -34,24 +38,155 @@ void SynthVoice::controllerMoved(int controllerNumber, int newControllerValue)
 
 void SynthVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
 {
-	if (!isVoiceActive()) return;
-	if (processorSequence == nullptr) return;
+	if (render(startSample, numSamples))
+		addTo(outputBuffer, startSample, numSamples);
+}
+
+bool SynthVoice::render(int startSample, int numSamples)
+{
+	const auto numRendered = beginBlock(startSample, numSamples);
+	if (numRendered < 0) return false;
+
+	renderSamples(numRendered);
+	finishBlock(startSample, numSamples);
+
+	return true;
+}
+
+void SynthVoice::renderLanes(SynthVoice* const* voices, int numVoices, int startSample, int numSamples,
+	NodeProcessorSequence::LaneBuffers& buffers, bool* rendered)
+{
+	jassert(numVoices <= max_voice_lanes);
+
+	SynthVoice* laneVoices[max_voice_lanes];
+	int numLaneVoices = 0;
+	int numLaneSamples = -1;
+
+	for (int i = 0; i < numVoices; ++i)
+	{
+		const auto voice = voices[i];
+		const auto numRendered = voice->beginBlock(startSample, numSamples);
 
+		rendered[i] = numRendered >= 0;
+		if (!rendered[i]) continue;
+
+		if (numLaneSamples < 0) numLaneSamples = numRendered;
+
+		if (numRendered == numLaneSamples)
+			laneVoices[numLaneVoices++] = voice;
+		else
+			voice->renderNodeMajor(numRendered, buffers);
+	}
+
+	if (numLaneVoices == 1)
+	{
+		laneVoices[0]->renderNodeMajor(numLaneSamples, buffers);
+	}
+	else if (numLaneVoices > 1)
+	{
+		NodeProcessorSequence* sequences[max_voice_lanes];
+		StereoSample* outputs[max_voice_lanes];
+
+		for (int i = 0; i < numLaneVoices; ++i)
+		{
+			sequences[i] = laneVoices[i]->processorSequence;
+			outputs[i] = laneVoices[i]->renderedSamples.data();
+		}
+
+		sequences[0]->renderLanes(sequences, numLaneVoices, outputs, numLaneSamples, buffers);
+	}
+
+	for (int i = 0; i < numVoices; ++i)
+		if (rendered[i])
+			voices[i]->finishBlock(startSample, numSamples);
+}
+
+int SynthVoice::beginBlock(int startSample, int numSamples)
+{
+	if (!isVoiceActive()) return -1;
+	if (processorSequence == nullptr) return -1;
+
+	if (resampler.isBypassed())
+	{
+		processorSequence->startBlock(startSample, numSamples);
+		return numSamples;
+	}
+
+	const auto hostRate = getSampleRate();
+	const auto renderRate = getRenderRate();
+	const auto firstInBlock = Resampler::getRenderedSample(blockStart - 1, renderRate, hostRate) + 1;
+
+	// A new note starts rendering with the samples of its first host sample, on the grid of the shared values
+	if (isNewNote)
+	{
+		lastRendered = Resampler::getRenderedSample(blockStart + startSample - 1, renderRate, hostRate);
+		resampler.reset();
+		isNewNote = false;
+	}
+
+	const auto last = Resampler::getRenderedSample(blockStart + startSample + numSamples - 1, renderRate, hostRate);
+	const auto numRendered = (int)(last - lastRendered);
+
+	processorSequence->startBlock((int)(lastRendered + 1 - firstInBlock), numRendered);
+
+	return numRendered;
+}
+
+void SynthVoice::renderSamples(int numRendered)
+{
+	jassert((size_t)numRendered <= renderedSamples.size());
+
+	processorSequence->renderSamples(renderedSamples.data(), numRendered);
+}
+
+void SynthVoice::renderNodeMajor(int numRendered, NodeProcessorSequence::LaneBuffers& buffers)
+{
+	auto sequence = processorSequence;
+	auto output = renderedSamples.data();
+
+	processorSequence->renderLanes(&sequence, 1, &output, numRendered, buffers);
+}
+
+void SynthVoice::finishBlock(int startSample, int numSamples)
+{
 	const auto channels = buffer.getArrayOfWritePointers();
 
 	const auto end = startSample + numSamples;
+	auto next = renderedSamples.begin();
 
-	for (int i = startSample; i < end; ++i)
+	if (resampler.isBypassed())
 	{
-		const auto stereoSample = processorSequence->getNextStereoSample();
+		for (int i = startSample; i < end; ++i, ++next)
+		{
+			channels[0][i] = next->left;
+			channels[1][i] = next->right;
+		}
+	}
+	else
+	{
+		const auto hostRate = getSampleRate();
+		const auto renderRate = getRenderRate();
+
+		for (int i = startSample; i < end; ++i)
+		{
+			const auto hostSample = blockStart + i;
+
+			const auto rendered = Resampler::getRenderedSample(hostSample, renderRate, hostRate);
+
+			while (lastRendered < rendered)
+			{
+				resampler.push(*next++);
+				++lastRendered;
+			}
+
+			const auto stereoSample = resampler.process(hostSample);
 
-		channels[0][i] = stereoSample.left;
-		channels[1][i] = stereoSample.right;
+			channels[0][i] = stereoSample.left;
+			channels[1][i] = stereoSample.right;
+		}
 	}
 
 	adsr.applyEnvelopeToBuffer(buffer, startSample, numSamples);
-	outputBuffer.addFrom(0, startSample, buffer, 0, startSample, numSamples);
-	outputBuffer.addFrom(1, startSample, buffer, 1, startSample, numSamples);
 
 	if (!adsr.isActive())
 	{
@@ -59,9 +194,16 @@ void SynthVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int sta
 	}
 }
 
+void SynthVoice::addTo(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) const
+{
+	outputBuffer.addFrom(0, startSample, buffer, 0, startSample, numSamples);
+	outputBuffer.addFrom(1, startSample, buffer, 1, startSample, numSamples);
+}
+
 void SynthVoice::prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels)
 {
 	buffer.setSize(outputChannels, samplesPerBlock);
+	renderedSamples.resize((size_t)samplesPerBlock + 1);
 
 	juce::ADSR::Parameters adsrParams;
 	adsrParams.attack = 0.f;
@@ -72,18 +214,120 @@ void SynthVoice::prepareToPlay(double sampleRate, int samplesPerBlock, int outpu
 	adsr.setSampleRate(sampleRate);
 	adsr.setParameters(adsrParams);
 
-	if (processorSequence != nullptr) processorSequence->prepareToPlay(sampleRate);
+	resampler.prepare(getRenderRate(), sampleRate);
 }
 
-void SynthVoice::setProcessorSequence(NodeProcessorSequence* sequence)
+void SynthVoice::setProcessorSequence(NodeProcessorSequence* sequence, double newGraphRenderRate)
 {
-	processorSequence = std::unique_ptr<NodeProcessorSequence>(sequence);
-	processorSequence->prepareToPlay(getSampleRate());
+	processorSequence = sequence;
+	graphRenderRate = newGraphRenderRate;
+
+	resampler.prepare(getRenderRate(), getSampleRate());
+	isNewNote = true;
 }
 
 void SynthVoice::update(juce::ADSR::Parameters parameters, bool isPlaying, double bps, double freeSeconds, double freeSamples,
-	double positionSeconds, double positionSamples)
+	double positionSeconds, double positionSamples, int seed)
 {
 	adsr.setParameters(parameters);
-	if (processorSequence != nullptr) processorSequence->sync(isPlaying, bps, freeSeconds, freeSamples, positionSeconds, positionSamples);
+	randomSeed = seed;
+	blockStart = freeSamples;
+
+	// The sample counts continue at the first sample rendered in the block
+	const auto hostRate = getSampleRate();
+	const auto renderedFree = (double)(Resampler::getRenderedSample(freeSamples - 1, getRenderRate(), hostRate) + 1);
+	const auto renderedPosition = (double)(Resampler::getRenderedSample(positionSamples - 1, getRenderRate(), hostRate) + 1);
+
+	if (processorSequence != nullptr) processorSequence->sync(isPlaying, bps, freeSeconds, renderedFree, positionSeconds, renderedPosition);
+}
+
+double SynthVoice::getRenderRate() const
+{
+	return Resampler::getRenderRate(graphRenderRate, getSampleRate());
+}
+
+std::unique_ptr<VoiceThreadPool> VoiceSynthesiser::createThreadPool() const
+{
+	const auto numWorkers = juce::jlimit(1, juce::jmax(1, getNumVoices() - 1), juce::SystemStats::getNumCpus() - 1);
+	return std::make_unique<VoiceThreadPool>(numWorkers);
+}
+
+std::unique_ptr<VoiceThreadPool> VoiceSynthesiser::setThreadPool(std::unique_ptr<VoiceThreadPool> newPool)
+{
+	std::swap(pool, newPool);
+
+	if (pool != nullptr)
+		allocateJob();
+
+	return newPool;
+}
+
+void VoiceSynthesiser::setVoiceLanes(bool shouldRenderInLanes)
+{
+	renderInLanes = shouldRenderInLanes;
+
+	allocateJob();
+}
+
+void VoiceSynthesiser::setLaneBuffers(NodeProcessorSequence::LaneBuffers* const* buffers, int newNumLanesPerGroup) noexcept
+{
+	job.laneBuffers = buffers;
+	numLanesPerGroup = newNumLanesPerGroup;
+}
+
+void VoiceSynthesiser::allocateJob()
+{
+	job.voices.ensureStorageAllocated(getNumVoices());
+	job.rendered.resize(getNumVoices());
+}
+
+void VoiceSynthesiser::renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples)
+{
+	job.numLanes = renderInLanes && job.laneBuffers != nullptr ? numLanesPerGroup : 1;
+
+	if (pool == nullptr && job.numLanes == 1)
+	{
+		juce::Synthesiser::renderVoices(outputAudio, startSample, numSamples);
+		return;
+	}
+
+	job.voices.clearQuick();
+
+	for (const auto voice : voices)
+		if (voice->isVoiceActive())
+			job.voices.add(static_cast<SynthVoice*>(voice));
+
+	job.startSample = startSample;
+	job.numSamples = numSamples;
+
+	const auto numTasks = (job.voices.size() + job.numLanes - 1) / job.numLanes;
+
+	// A single task isn't worth handing out
+	if (pool != nullptr && numTasks > 1)
+	{
+		pool->run(job, numTasks);
+	}
+	else
+	{
+		for (int i = 0; i < numTasks; ++i)
+			job.run(i);
+	}
+
+	for (int i = 0; i < job.voices.size(); ++i)
+		if (job.rendered.getUnchecked(i))
+			job.voices.getUnchecked(i)->addTo(outputAudio, startSample, numSamples);
+}
+
+void VoiceSynthesiser::RenderJob::run(int task)
+{
+	if (numLanes == 1)
+	{
+		rendered.setUnchecked(task, voices.getUnchecked(task)->render(startSample, numSamples));
+		return;
+	}
+
+	const auto first = task * numLanes;
+
+	SynthVoice::renderLanes(voices.begin() + first, juce::jmin(numLanes, voices.size() - first), startSample, numSamples,
+		*laneBuffers[task], rendered.begin() + first);
 }
@@ -3,6 +3,8 @@
 #include <JuceHeader.h>
 
 #include "NodeProcessor.h"
+#include "Resampler.h"
+#include "VoiceThreadPool.h"
 
 class SynthVoice : public juce::SynthesiserVoice
 {
@@ -17,14 +19,108 @@ public:
 	void prepareToPlay(double sampleRate, int samplesPerBlock, int outputChannels);
 	void renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override;
 
-	void setProcessorSequence(NodeProcessorSequence* sequence);
+	// renderNextBlock in two steps: render writes the block into the buffer of the voice and returns whether the voice
+	// played, addTo adds it to the output. Voices can render in parallel, only adding has to be done one after another.
+	bool render(int startSample, int numSamples);
+	void addTo(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) const;
 
-	void update(juce::ADSR::Parameters parameters, bool isPlaying, double bps, double freeSeconds, double freeSamples, double positionSeconds, double positionSamples);
+	// render for several voices at once, with the voices in the lanes of NodeProcessorSequence::renderLanes.
+	// Voices that render another number of samples at the render rate than the first, like a note that started in
+	// the block, and voices without others render on their own, one program after the other over the whole block.
+	// Writes whether each voice played to rendered.
+	static void renderLanes(SynthVoice* const* voices, int numVoices, int startSample, int numSamples,
+		NodeProcessorSequence::LaneBuffers& buffers, bool* rendered);
+
+	// newGraphRenderRate is the rate the graph was set to render at, 0 for the host rate. The sequence is owned by
+	// the caller and has to be prepared for the render rate already, so this neither allocates nor frees.
+	void setProcessorSequence(NodeProcessorSequence* sequence, double newGraphRenderRate);
+
+	void update(juce::ADSR::Parameters parameters, bool isPlaying, double bps, double freeSeconds, double freeSamples, double positionSeconds, double positionSamples, int seed);
 
 private:
 	juce::ADSR adsr;
-	std::unique_ptr<NodeProcessorSequence> processorSequence;
+	int randomSeed = 0;
+	NodeProcessorSequence* processorSequence = nullptr;
 	juce::AudioBuffer<float> buffer;
+
+	// The rate the sequence renders at, see Resampler::getRenderRate
+	double getRenderRate() const;
+
+	// The steps of render: beginBlock starts the block of the sequence and returns how many samples it renders
+	// at the render rate, -1 if the voice doesn't play. They are rendered into renderedSamples, and finishBlock
+	// converts them to the host rate and applies the envelope.
+	int beginBlock(int startSample, int numSamples);
+	void renderSamples(int numRendered);
+	void finishBlock(int startSample, int numSamples);
+
+	// renderSamples in node-major order: each program runs over the whole block in the block kernels
+	void renderNodeMajor(int numRendered, NodeProcessorSequence::LaneBuffers& buffers);
+
+	// The output of the sequence in the current block. The grid of the render rate can put one more sample into a block.
+	std::vector<StereoSample> renderedSamples;
+
+	// Below the host rate, the resampler converts the output of the sequence
+	Resampler resampler;
+	double graphRenderRate = 0;
+
+	// The free running host time of the block, and the last sample rendered at the render rate
+	double blockStart = 0;
+	juce::int64 lastRendered = 0;
+	bool isNewNote = false;
+};
+
+
+// A synthesiser that can render its active voices in parallel on a VoiceThreadPool, and in groups that are
+// evaluated together in the lanes of the block kernels. Each voice renders into its own buffer, and the buffers
+// are added to the output in the order of the voices, so the output is the same as when the voices render one
+// after another. With both, every group of lanes is a task of the pool.
+class VoiceSynthesiser : public juce::Synthesiser
+{
+public:
+	// A pool with one worker per core besides the audio thread, and no more than can get a voice. It starts its
+	// threads, so it is created without the callback lock held.
+	std::unique_ptr<VoiceThreadPool> createThreadPool() const;
+
+	// Renders the voices on the pool, or one after another without one. Returns the pool used before, which stops
+	// its threads when it is destroyed, so that has to happen after the callback lock is released.
+	// Have to be called with the callback lock of the processor held, after all voices were added.
+	std::unique_ptr<VoiceThreadPool> setThreadPool(std::unique_ptr<VoiceThreadPool> newPool);
+	void setVoiceLanes(bool shouldRenderInLanes);
+
+	bool isRenderingInParallel() const noexcept { return pool != nullptr; }
+	bool isRenderingInLanes() const noexcept { return renderInLanes; }
+
+	// The buffers for the groups of numLanes voices, one per group, for the sequences the voices render now.
+	// They are owned by the caller. Has to be called on the audio thread, whenever the voices get new sequences.
+	void setLaneBuffers(NodeProcessorSequence::LaneBuffers* const* buffers, int numLanesPerGroup) noexcept;
+
+protected:
+	void renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples) override;
+
+private:
+	struct RenderJob : VoiceThreadPool::Job
+	{
+		// Renders a voice, or a group of numLanes voices
+		void run(int task) override;
+
+		// Allocated for all voices in advance
+		juce::Array<SynthVoice*> voices;
+		juce::Array<bool> rendered;
+
+		// 1 without lanes. Each group has buffers of its own, so groups can render in parallel.
+		int numLanes = 1;
+		NodeProcessorSequence::LaneBuffers* const* laneBuffers = nullptr;
+
+		int startSample = 0;
+		int numSamples = 0;
+	};
+
+	void allocateJob();
+
+	std::unique_ptr<VoiceThreadPool> pool;
+	bool renderInLanes = false;
+	int numLanesPerGroup = 1;
+	RenderJob job;
 };
 
 
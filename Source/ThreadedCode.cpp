@@ -0,0 +1,418 @@
+#include "ThreadedCode.h"
+
+#include "FastMath.h"
+#include "RandomGenerator.h"
+
+#if JUCE_GCC || JUCE_CLANG
+#define BBGRAPH_DIRECT_THREADING 1
+#else
+#define BBGRAPH_DIRECT_THREADING 0
+#endif
+
+#pragma region Ops
+
+// x is the left operand, y the right one, both of the sample type. The expressions are the same as in the other backends.
+// The ops that depend on the MathOptions have a variant for every mode.
+
+#define BBGRAPH_BINARY_OPS(X) \
+	X(add, x + y) \
+	X(subtract, x - y) \
+	X(multiply, x * y) \
+	X(divide, x / y) \
+	X(modulo, std::fmod(x, y)) \
+	X(bitAnd, (int)x & (int)y) \
+	X(bitOr, (int)x | (int)y) \
+	X(bitXor, (int)x ^ (int)y) \
+	X(leftShift, (Sample)((long)x << (int)y)) \
+	X(rightShift, (int)x >> (int)y) \
+	X(logicalAnd, (int)x && (int)y) \
+	X(logicalOr, (int)x || (int)y) \
+	X(equal, juce::approximatelyEqual(x, y)) \
+	X(notEqual, !juce::approximatelyEqual(x, y)) \
+	X(less, x < y) \
+	X(lessOrEqual, x < y || juce::approximatelyEqual(x, y)) \
+	X(greater, x > y) \
+	X(greaterOrEqual, x > y || juce::approximatelyEqual(x, y)) \
+	X(power, std::pow(x, y)) \
+	X(equalExact, x == y) \
+	X(notEqualExact, x != y) \
+	X(lessOrEqualExact, x <= y) \
+	X(greaterOrEqualExact, x >= y) \
+	X(powerPolynomial, FastMath::power(x, y))
+
+#define BBGRAPH_UNARY_OPS(X) \
+	X(invert, -x) \
+	X(bitNot, ~(int)x) \
+	X(logicalNot, !(int)x) \
+	X(sqrt, std::sqrt(x)) \
+	X(cbrt, std::cbrt(x)) \
+	X(exp, std::exp(x)) \
+	X(exp2, std::exp2(x)) \
+	X(log, std::log(x)) \
+	X(log2, std::log2(x)) \
+	X(log10, std::log10(x)) \
+	X(absolute, std::abs(x)) \
+	X(sine, std::sin(x)) \
+	X(cosine, std::cos(x)) \
+	X(tangent, std::tan(x)) \
+	X(arcsine, std::asin(x)) \
+	X(arccosine, std::acos(x)) \
+	X(arctangent, std::atan(x)) \
+	X(finite, isinf(x) || isnan(x) ? (Sample)0 : x) \
+	X(expPolynomial, FastMath::exp(x)) \
+	X(exp2Polynomial, FastMath::exp2(x)) \
+	X(logPolynomial, FastMath::log(x)) \
+	X(log2Polynomial, FastMath::log2(x)) \
+	X(log10Polynomial, FastMath::log10(x)) \
+	X(sinePolynomial, FastMath::sine(x)) \
+	X(cosinePolynomial, FastMath::cosine(x)) \
+	X(tangentPolynomial, FastMath::tangent(x)) \
+	X(sineTable, FastMath::tableSine(x)) \
+	X(cosineTable, FastMath::tableCosine(x)) \
+	X(tangentTable, FastMath::tableTangent(x))
+
+#define BBGRAPH_OPCODE(name, expression) X_OPCODE(name)
+
+#define BBGRAPH_OPCODES \
+	BBGRAPH_BINARY_OPS(BBGRAPH_OPCODE) \
+	BBGRAPH_UNARY_OPS(BBGRAPH_OPCODE) \
+	X_OPCODE(random) \
+	X_OPCODE(loadGlobal) \
+	X_OPCODE(loadInput) \
+	X_OPCODE(loadValue) \
+	X_OPCODE(end)
+
+enum class Opcode
+{
+#define X_OPCODE(name) name,
+	BBGRAPH_OPCODES
+#undef X_OPCODE
+};
+
+#pragma endregion
+
+#pragma region Compiler
+
+template <typename Sample>
+int ThreadedCode<Sample>::getOpcode(Op op, const ByteCodeProcessor::MathOptions& options)
+{
+	using Precision = ByteCodeProcessor::Precision;
+
+	const auto exact = options.exactComparisons;
+	const auto polynomial = options.precision != Precision::exact;
+	const auto table = options.precision == Precision::table;
+
+	switch (op)
+	{
+	case Op::add: return (int)Opcode::add;
+	case Op::subtract: return (int)Opcode::subtract;
+	case Op::multiply: return (int)Opcode::multiply;
+	case Op::divide: return (int)Opcode::divide;
+	case Op::modulo: return (int)Opcode::modulo;
+	case Op::bitand: return (int)Opcode::bitAnd;
+	case Op::bitor: return (int)Opcode::bitOr;
+	case Op::bitxor: return (int)Opcode::bitXor;
+	case Op::lshift: return (int)Opcode::leftShift;
+	case Op::rshift: return (int)Opcode::rightShift;
+	case Op::and: return (int)Opcode::logicalAnd;
+	case Op::or: return (int)Opcode::logicalOr;
+	case Op::equal: return (int)(exact ? Opcode::equalExact : Opcode::equal);
+	case Op::notequal: return (int)(exact ? Opcode::notEqualExact : Opcode::notEqual);
+	case Op::less: return (int)Opcode::less;
+	case Op::lessorequal: return (int)(exact ? Opcode::lessOrEqualExact : Opcode::lessOrEqual);
+	case Op::greater: return (int)Opcode::greater;
+	case Op::greaterorequal: return (int)(exact ? Opcode::greaterOrEqualExact : Opcode::greaterOrEqual);
+	case Op::power: return (int)(polynomial ? Opcode::powerPolynomial : Opcode::power);
+
+	case Op::invert: return (int)Opcode::invert;
+	case Op::bitnot: return (int)Opcode::bitNot;
+	case Op::not: return (int)Opcode::logicalNot;
+	case Op::sqrt: return (int)Opcode::sqrt;
+	case Op::cbrt: return (int)Opcode::cbrt;
+	case Op::exp: return (int)(polynomial ? Opcode::expPolynomial : Opcode::exp);
+	case Op::exp2: return (int)(polynomial ? Opcode::exp2Polynomial : Opcode::exp2);
+	case Op::log: return (int)(polynomial ? Opcode::logPolynomial : Opcode::log);
+	case Op::log2: return (int)(polynomial ? Opcode::log2Polynomial : Opcode::log2);
+	case Op::log10: return (int)(polynomial ? Opcode::log10Polynomial : Opcode::log10);
+	case Op::absolute: return (int)Opcode::absolute;
+	case Op::sine: return (int)(table ? Opcode::sineTable : polynomial ? Opcode::sinePolynomial : Opcode::sine);
+	case Op::cosine: return (int)(table ? Opcode::cosineTable : polynomial ? Opcode::cosinePolynomial : Opcode::cosine);
+	case Op::tangent: return (int)(table ? Opcode::tangentTable : polynomial ? Opcode::tangentPolynomial : Opcode::tangent);
+	case Op::arcsine: return (int)Opcode::arcsine;
+	case Op::arccosine: return (int)Opcode::arccosine;
+	case Op::arctangent: return (int)Opcode::arctangent;
+	case Op::finite: return (int)Opcode::finite;
+
+	case Op::random: return (int)Opcode::random;
+
+	default:
+		jassertfalse;
+		return (int)Opcode::end;
+	}
+}
+
+template <typename Sample>
+std::unique_ptr<ThreadedCode<Sample>> ThreadedCode<Sample>::compile(const std::vector<Op>& byteCode,
+	const std::vector<double>& numberConstants, const ByteCodeProcessor::MathOptions& options)
+{
+	static constexpr int globalOffsets[] =
+	{
+		offsetof(GlobalValues<Sample>, fs),
+		offsetof(GlobalValues<Sample>, f),
+		offsetof(GlobalValues<Sample>, ps),
+		offsetof(GlobalValues<Sample>, p),
+		offsetof(GlobalValues<Sample>, rs),
+		offsetof(GlobalValues<Sample>, r),
+		offsetof(GlobalValues<Sample>, n),
+		offsetof(GlobalValues<Sample>, t),
+
+		offsetof(GlobalValues<Sample>, nf),
+		offsetof(GlobalValues<Sample>, sr),
+		offsetof(GlobalValues<Sample>, bps)
+	};
+
+	std::unique_ptr<ThreadedCode> threadedCode(new ThreadedCode);
+	auto& constants = threadedCode->constants;
+
+	// The constant or variable that each op pushes. Equal constants and variables share a register.
+	std::vector<int> constantRegisters(byteCode.size(), -1);
+	std::vector<int> variableRegisters(byteCode.size(), -1);
+	std::vector<std::pair<Opcode, int>> variables;
+	int nextConstant = 0;
+
+	for (size_t i = 0; i < byteCode.size(); ++i)
+	{
+		const auto op = byteCode[i];
+		Sample value = 0;
+		std::pair<Opcode, int> variable{ Opcode::end, 0 };
+
+		switch (op)
+		{
+		case Op::numberConstant: value = (Sample)numberConstants[nextConstant++]; break;
+		case Op::pi: value = (Sample)juce::MathConstants<double>::pi; break;
+		case Op::twopi: value = (Sample)juce::MathConstants<double>::twoPi; break;
+		case Op::halfpi: value = (Sample)juce::MathConstants<double>::halfPi; break;
+		case Op::e: value = (Sample)juce::MathConstants<double>::euler; break;
+
+		case Op::fs: case Op::f: case Op::ps: case Op::p: case Op::rs: case Op::r: case Op::n: case Op::t:
+		case Op::nf: case Op::sr: case Op::bps:
+			variable = { Opcode::loadGlobal, globalOffsets[op - Op::fs] };
+			break;
+
+		case Op::a: case Op::b: case Op::c: case Op::d:
+			variable = { Opcode::loadInput, op - Op::a };
+			break;
+
+		// Cached values are stored after the inputs
+		case Op::cachedValue:
+			variable = { Opcode::loadInput, expr_node_num_ins + (int)numberConstants[nextConstant++] };
+			break;
+
+		case Op::nodeValue:
+			variable = { Opcode::loadValue, (int)numberConstants[nextConstant++] };
+			break;
+
+		default:
+			continue;
+		}
+
+		if (variable.first != Opcode::end)
+		{
+			auto existing = std::find(variables.begin(), variables.end(), variable);
+			variableRegisters[i] = (int)std::distance(variables.begin(), existing);
+
+			if (existing == variables.end())
+				variables.push_back(variable);
+
+			continue;
+		}
+
+		// Compared bitwise, so 0 and -0 stay apart
+		auto existing = std::find_if(constants.begin(), constants.end(), [value](Sample c)
+			{ return std::memcmp(&c, &value, sizeof(Sample)) == 0; });
+
+		constantRegisters[i] = (int)std::distance(constants.begin(), existing);
+
+		if (existing == constants.end())
+			constants.push_back(value);
+	}
+
+	const auto numConstants = (int)constants.size();
+	const auto firstTemporary = numConstants + (int)variables.size();
+
+	for (size_t i = 0; i < variables.size(); ++i)
+		threadedCode->emit((int)variables[i].first, variables[i].second, 0, numConstants + (int)i);
+
+	// The registers of the values on the stack. The result of an op goes into the temporary for its stack position.
+	std::vector<int> stack;
+	int numTemporaries = 0;
+
+	for (size_t i = 0; i < byteCode.size(); ++i)
+	{
+		const auto op = byteCode[i];
+
+		if (constantRegisters[i] >= 0)
+		{
+			stack.push_back(constantRegisters[i]);
+		}
+		else if (variableRegisters[i] >= 0)
+		{
+			stack.push_back(numConstants + variableRegisters[i]);
+		}
+		else if (op == Op::random)
+		{
+			const auto result = firstTemporary + (int)stack.size();
+			threadedCode->emit((int)Opcode::random, 0, 0, result);
+			stack.push_back(result);
+		}
+		else if (ByteCodeProcessor::tokens[op].arity == 2)
+		{
+			const auto y = stack.back();
+			stack.pop_back();
+
+			const auto result = firstTemporary + (int)stack.size() - 1;
+			threadedCode->emit(getOpcode(op, options), stack.back(), y, result);
+			stack.back() = result;
+		}
+		else
+		{
+			const auto result = firstTemporary + (int)stack.size() - 1;
+			threadedCode->emit(getOpcode(op, options), stack.back(), 0, result);
+			stack.back() = result;
+		}
+
+		numTemporaries = juce::jmax(numTemporaries, (int)stack.size());
+	}
+
+	jassert(stack.size() == 1);
+
+	threadedCode->emit((int)Opcode::end, stack.back(), 0, 0);
+	threadedCode->numRegisters = firstTemporary + numTemporaries;
+
+	return threadedCode;
+}
+
+template <typename Sample>
+void ThreadedCode<Sample>::initialiseRegisters(Sample* registers) const
+{
+	std::copy(constants.begin(), constants.end(), registers);
+}
+
+template <typename Sample>
+void ThreadedCode<Sample>::emit(int opcode, int x, int y, int result)
+{
+	Instruction instruction;
+
+#if BBGRAPH_DIRECT_THREADING
+	static const auto handlers = []
+	{
+		const void* const* addresses = nullptr;
+		execute(nullptr, nullptr, {}, nullptr, &addresses);
+		return addresses;
+	}();
+
+	instruction.handler = handlers[opcode];
+#else
+	instruction.opcode = opcode;
+#endif
+
+	instruction.x = x;
+	instruction.y = y;
+	instruction.result = result;
+
+	code.push_back(instruction);
+}
+
+#pragma endregion
+
+#pragma region Interpreter
+
+#if BBGRAPH_DIRECT_THREADING
+#define BBGRAPH_HANDLER(name) name##Handler:
+#define BBGRAPH_DISPATCH goto *(++ip)->handler
+#else
+#define BBGRAPH_HANDLER(name) case Opcode::name:
+#define BBGRAPH_DISPATCH continue
+#endif
+
+#define BBGRAPH_BINARY_HANDLER(name, expression) \
+	BBGRAPH_HANDLER(name) \
+	{ \
+		const auto x = registers[ip->x]; \
+		const auto y = registers[ip->y]; \
+		registers[ip->result] = (Sample)(expression); \
+		BBGRAPH_DISPATCH; \
+	}
+
+#define BBGRAPH_UNARY_HANDLER(name, expression) \
+	BBGRAPH_HANDLER(name) \
+	{ \
+		const auto x = registers[ip->x]; \
+		registers[ip->result] = (Sample)(expression); \
+		BBGRAPH_DISPATCH; \
+	}
+
+template <typename Sample>
+Sample ThreadedCode<Sample>::execute(const Instruction* ip, const Sample* inputValues, const GlobalValues<Sample>& globalValues,
+	Sample* registers, const void* const** handlers)
+{
+#if BBGRAPH_DIRECT_THREADING
+	static const void* const handlerAddresses[] =
+	{
+#define X_OPCODE(name) &&name##Handler,
+		BBGRAPH_OPCODES
+#undef X_OPCODE
+	};
+
+	if (handlers != nullptr)
+	{
+		*handlers = handlerAddresses;
+		return 0;
+	}
+
+	goto *ip->handler;
+#else
+	juce::ignoreUnused(handlers);
+
+	for (;; ++ip)
+	{
+		switch ((Opcode)ip->opcode)
+		{
+#endif
+			BBGRAPH_BINARY_OPS(BBGRAPH_BINARY_HANDLER)
+			BBGRAPH_UNARY_OPS(BBGRAPH_UNARY_HANDLER)
+
+			BBGRAPH_HANDLER(random)
+			{
+				registers[ip->result] = globalValues.random->template next<Sample>();
+				BBGRAPH_DISPATCH;
+			}
+			BBGRAPH_HANDLER(loadGlobal)
+			{
+				registers[ip->result] = *reinterpret_cast<const Sample*>(reinterpret_cast<const char*>(&globalValues) + ip->x);
+				BBGRAPH_DISPATCH;
+			}
+			BBGRAPH_HANDLER(loadInput)
+			{
+				registers[ip->result] = inputValues[ip->x];
+				BBGRAPH_DISPATCH;
+			}
+			BBGRAPH_HANDLER(loadValue)
+			{
+				registers[ip->result] = globalValues.values[ip->x];
+				BBGRAPH_DISPATCH;
+			}
+			BBGRAPH_HANDLER(end)
+			{
+				return registers[ip->x];
+			}
+#if !BBGRAPH_DIRECT_THREADING
+		}
+	}
+#endif
+}
+
+#pragma endregion
+
+template class ThreadedCode<double>;
+template class ThreadedCode<float>;
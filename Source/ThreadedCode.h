@@ -0,0 +1,61 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "ByteCodeProcessor.h"
+
+// The postfix byte code of a ByteCodeProcessor, translated to register machine code for the interpreter.
+// Every instruction names the registers of its operands and its result, so constants and variables are read
+// where they are instead of being pushed first. The register file holds the constants, then the variables the
+// expression reads, then the temporaries. On GCC and Clang every instruction holds the address of its handler
+// (direct threading), elsewhere it holds an opcode for a switch. The registers hold values of the sample type.
+template <typename Sample>
+class ThreadedCode
+{
+public:
+	static std::unique_ptr<ThreadedCode> compile(const std::vector<ByteCodeProcessor::Op>& byteCode,
+		const std::vector<double>& numberConstants, const ByteCodeProcessor::MathOptions& options);
+
+	int getNumRegisters() const { return numRegisters; }
+
+	// Writes the constants into a register file. This only has to be done once, run never overwrites them.
+	void initialiseRegisters(Sample* registers) const;
+
+	Sample run(const Sample* inputValues, const GlobalValues<Sample>& globalValues, Sample* registers) const
+	{
+		return execute(code.data(), inputValues, globalValues, registers, nullptr);
+	}
+
+private:
+	using Op = ByteCodeProcessor::Op;
+
+	struct Instruction
+	{
+		union
+		{
+			const void* handler;
+			int opcode;
+		};
+
+		// Registers, or the offset of a global value or the index of an input or value for the load instructions
+		int x;
+		int y;
+		int result;
+	};
+
+	ThreadedCode() = default;
+
+	// Called with handlers != nullptr, only returns the handler addresses for the opcodes
+	static Sample execute(const Instruction* ip, const Sample* inputValues, const GlobalValues<Sample>& globalValues,
+		Sample* registers, const void* const** handlers);
+
+	static int getOpcode(Op op, const ByteCodeProcessor::MathOptions& options);
+
+	void emit(int opcode, int x, int y, int result);
+
+	std::vector<Instruction> code;
+	std::vector<Sample> constants;
+	int numRegisters = 0;
+
+	JUCE_DECLARE_NON_COPYABLE(ThreadedCode)
+};
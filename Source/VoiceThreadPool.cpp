@@ -0,0 +1,230 @@
+#include "VoiceThreadPool.h"
+
+#if JUCE_INTEL
+#include <immintrin.h>
+#endif
+
+#if JUCE_WINDOWS
+#include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+#include <dispatch/dispatch.h>
+#else
+#include <cerrno>
+#include <semaphore.h>
+#endif
+
+// Wakes a thread without a mutex. Posting is an atomic increment, and a system call if the thread waits.
+// juce::WaitableEvent can't be used on the audio thread, its signal locks the mutex the waiting thread uses.
+class VoiceThreadPool::Semaphore
+{
+public:
+	Semaphore()
+	{
+#if JUCE_WINDOWS
+		handle = CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr);
+#elif JUCE_MAC || JUCE_IOS
+		semaphore = dispatch_semaphore_create(0);
+#else
+		sem_init(&semaphore, 0, 0);
+#endif
+	}
+
+	~Semaphore()
+	{
+#if JUCE_WINDOWS
+		CloseHandle(handle);
+#elif JUCE_MAC || JUCE_IOS
+		dispatch_release(semaphore);
+#else
+		sem_destroy(&semaphore);
+#endif
+	}
+
+	void post()
+	{
+#if JUCE_WINDOWS
+		ReleaseSemaphore(handle, 1, nullptr);
+#elif JUCE_MAC || JUCE_IOS
+		dispatch_semaphore_signal(semaphore);
+#else
+		sem_post(&semaphore);
+#endif
+	}
+
+	void wait()
+	{
+#if JUCE_WINDOWS
+		WaitForSingleObject(handle, INFINITE);
+#elif JUCE_MAC || JUCE_IOS
+		dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+#else
+		while (sem_wait(&semaphore) != 0 && errno == EINTR)
+		{
+		}
+#endif
+	}
+
+private:
+#if JUCE_WINDOWS
+	HANDLE handle;
+#elif JUCE_MAC || JUCE_IOS
+	dispatch_semaphore_t semaphore;
+#else
+	sem_t semaphore;
+#endif
+
+	JUCE_DECLARE_NON_COPYABLE(Semaphore)
+};
+
+class VoiceThreadPool::Worker : public juce::Thread
+{
+public:
+	Worker(VoiceThreadPool& p, int queueIndex) : juce::Thread("Voice renderer " + juce::String(queueIndex)), pool(p), queue(queueIndex)
+	{
+	}
+
+	void run() override
+	{
+		const auto spinTicks = juce::Time::getHighResolutionTicksPerSecond() * spinMicroseconds / 1000000;
+		auto lastTask = juce::Time::getHighResolutionTicks();
+
+		while (!threadShouldExit())
+		{
+			if (pool.runTask(queue))
+			{
+				lastTask = juce::Time::getHighResolutionTicks();
+				continue;
+			}
+
+			if (juce::Time::getHighResolutionTicks() - lastTask < spinTicks)
+			{
+				pause();
+				continue;
+			}
+
+			// run checks isSleeping after it published the ranges, so either it sees the flag or the worker sees the tasks.
+			// The destructor does the same with the exit flag.
+			isSleeping.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			const auto hasWork = pool.hasTasks() || threadShouldExit();
+
+			// wake clears the flag before it posts. If it got there first, its post has to be taken, or the next
+			// wait would return at once.
+			if (!hasWork || !isSleeping.exchange(false))
+				semaphore.wait();
+
+			lastTask = juce::Time::getHighResolutionTicks();
+		}
+	}
+
+	// Wakes the worker if it sleeps. A wake-up that comes before the worker waits isn't lost, wait returns at once.
+	void wake()
+	{
+		if (isSleeping.load() && isSleeping.exchange(false))
+			semaphore.post();
+	}
+
+private:
+	// Far below the period of a block, so an idle worker doesn't keep its core busy
+	static constexpr juce::int64 spinMicroseconds = 50;
+
+	VoiceThreadPool& pool;
+	const int queue;
+	std::atomic<bool> isSleeping{ false };
+	Semaphore semaphore;
+};
+
+VoiceThreadPool::VoiceThreadPool(int numWorkers) : numQueues(numWorkers + 1), queues(new Queue[(size_t)(numWorkers + 1)])
+{
+	// Queue 0 belongs to the audio thread
+	for (int i = 1; i < numQueues; ++i)
+	{
+		const auto worker = workers.add(new Worker(*this, i));
+
+#if JUCE_VERSION >= 0x070003
+		worker->startRealtimeThread({});
+#else
+		worker->startThread(juce::Thread::realtimeAudioPriority);
+#endif
+	}
+}
+
+VoiceThreadPool::~VoiceThreadPool()
+{
+	for (auto worker : workers)
+	{
+		worker->signalThreadShouldExit();
+		worker->wake();
+	}
+
+	for (auto worker : workers)
+		worker->stopThread(1000);
+}
+
+void VoiceThreadPool::run(Job& newJob, int numTasks)
+{
+	jassert(remainingTasks.load() == 0);
+
+	job.store(&newJob, std::memory_order_relaxed);
+	remainingTasks.store(numTasks, std::memory_order_relaxed);
+
+	// Releasing the ranges publishes the job with them
+	for (int i = 0; i < numQueues; ++i)
+		queues[(size_t)i].range.store(pack(i * numTasks / numQueues, (i + 1) * numTasks / numQueues), std::memory_order_release);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	for (auto worker : workers)
+		worker->wake();
+
+	while (runTask(0))
+	{
+	}
+
+	// The tasks the workers already claimed are still running
+	while (remainingTasks.load(std::memory_order_acquire) != 0)
+		pause();
+}
+
+bool VoiceThreadPool::runTask(int queue)
+{
+	for (int i = 0; i < numQueues; ++i)
+	{
+		auto& range = queues[(size_t)((queue + i) % numQueues)].range;
+		auto current = range.load(std::memory_order_relaxed);
+
+		// Only the range as a whole tells whether a task is left. The job can't change before the claimed task is done.
+		while ((juce::uint32)current < (juce::uint32)(current >> 32))
+		{
+			if (range.compare_exchange_weak(current, current + 1, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				job.load(std::memory_order_relaxed)->run((int)(juce::uint32)current);
+				remainingTasks.fetch_sub(1, std::memory_order_release);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool VoiceThreadPool::hasTasks() const noexcept
+{
+	for (int i = 0; i < numQueues; ++i)
+	{
+		const auto current = queues[(size_t)i].range.load(std::memory_order_relaxed);
+
+		if ((juce::uint32)current < (juce::uint32)(current >> 32))
+			return true;
+	}
+
+	return false;
+}
+
+void VoiceThreadPool::pause()
+{
+#if JUCE_INTEL
+	_mm_pause();
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// A small pool of real-time worker threads that render voices in parallel with the audio thread.
+// run hands out the tasks of a job in one range per thread. Every thread works through its own range first and then
+// steals from the others, the calling thread as well, so all tasks are done even if no worker wakes up in time.
+// Claiming a task is one compare-and-swap. run never allocates, locks or waits for a worker to wake up. For a worker
+// that sleeps it posts a semaphore, which is an atomic increment and a system call without a mutex.
+// Workers spin for a few microseconds after their last task, which catches the tasks that are handed out while the
+// others are still being claimed, and then sleep until run wakes them for the next job.
+class VoiceThreadPool
+{
+public:
+	struct Job
+	{
+		virtual ~Job() = default;
+
+		virtual void run(int task) = 0;
+	};
+
+	explicit VoiceThreadPool(int numWorkers);
+	~VoiceThreadPool();
+
+	// Runs job.run for the tasks 0 to numTasks - 1 and returns when all of them are done
+	void run(Job& job, int numTasks);
+
+private:
+	class Semaphore;
+	class Worker;
+
+	// The next task and the end of the range of one thread, packed so they are claimed together.
+	// Each range is on its own cache line.
+	struct alignas(64) Queue
+	{
+		std::atomic<juce::uint64> range{ 0 };
+	};
+
+	static juce::uint64 pack(int next, int end) { return ((juce::uint64)(juce::uint32)end << 32) | (juce::uint32)next; }
+
+	// Claims and runs one task, from the queue of a thread or any other. Returns false if there were none left.
+	bool runTask(int queue);
+
+	// Whether any queue has a task left
+	bool hasTasks() const noexcept;
+
+	static void pause();
+
+	const int numQueues;
+	std::unique_ptr<Queue[]> queues;
+	std::atomic<Job*> job{ nullptr };
+	std::atomic<int> remainingTasks{ 0 };
+
+	juce::OwnedArray<Worker> workers;
+
+	JUCE_DECLARE_NON_COPYABLE(VoiceThreadPool)
+};